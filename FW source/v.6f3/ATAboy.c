@@ -9,6 +9,7 @@
 #include "class/cdc/cdc_device.h"
 #include "ide.h"
 #include "config.h"
+#include "badmap.h"
 #include "pico/util/queue.h"
 
 // ---------------------------------------------------------------------------
@@ -16,8 +17,10 @@
 // ---------------------------------------------------------------------------
 
 volatile bool is_mounted = false;
-volatile bool media_changed_waiting = false;
+volatile uint8_t mounted_luns = 0;              // bit 0 master, bit 1 slave
+volatile uint8_t media_changed_luns = 0;        // Unit Attention still owed, per LUN
 volatile bool cdc_connected = false;
+volatile uint32_t msc_last_us = 0;             // time_us_32() of the last MSC read/write
 
 // ---------------------------------------------------------------------------
 //  CDC queues — core 1 writes TX, reads RX; core 0 drains TX, fills RX
@@ -71,6 +74,7 @@ extern void core1_entry(void);
 int main(void) {
     // No pico_stdio — all console I/O goes through TinyUSB CDC via queues
     config_load();
+    badmap_init();
     ide_hw_init();
 
     // Init CDC queues
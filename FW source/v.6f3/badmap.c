@@ -0,0 +1,288 @@
+// ATAboy bad-sector map — extents of unreadable LBAs, kept per drive.
+// Reads that touch a mapped sector fail at once instead of waiting out the
+// drive's own retries again (ide_read_sectors), writes that succeed clear
+// it.  Master and slave each have a map in RAM, written to the flash
+// sector below the config once it has settled and the host has gone
+// quiet (the write stalls core 0, and USB with it); two drives share
+// that sector.
+
+#include "badmap.h"
+#include "ide.h"
+#include "hardware/flash.h"
+#include "hardware/sync.h"
+#include "pico/critical_section.h"
+#include "pico/multicore.h"
+#include "pico/time.h"
+#include <string.h>
+
+#define BADMAP_FLASH_OFFSET (2048 * 1024 - 2 * FLASH_SECTOR_SIZE)   // just below config
+#define BADMAP_MAGIC        0xBADB1C01
+#define BADMAP_SLOTS        2
+#define BADMAP_SETTLE_MS    5000    // quiet time before a flash write
+#define BADMAP_HOST_IDLE_MS 10000   // ...and since the host's last read/write
+
+extern volatile uint32_t msc_last_us;
+
+typedef struct {
+    uint32_t lba_lo;
+    uint32_t lba_hi;
+    uint32_t len;
+} flash_extent_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;                   // the older slot is reused for a new drive
+    uint16_t serial[10];            // IDENTIFY words 10-19
+    uint16_t count;
+    uint16_t reserved;
+    flash_extent_t ext[BADMAP_MAX];
+} slot_t;
+
+_Static_assert(sizeof(slot_t) * BADMAP_SLOTS <= FLASH_SECTOR_SIZE, "bad map slots exceed a flash sector");
+
+static const slot_t *flash_slots = (const slot_t *)(XIP_BASE + BADMAP_FLASH_OFFSET);
+
+typedef struct {
+    struct {
+        uint64_t lba;
+        uint32_t len;
+    } ext[BADMAP_MAX];
+    uint32_t n_ext;
+    uint32_t dropped;
+    uint16_t serial[10];
+    bool     keyed;                         // serial known: map is persisted
+    bool     dirty;
+    uint32_t changed_us;                   // time_us_32(): badmap_remove() is IDE_HOT
+} map_t;
+
+static map_t maps[2];                       // [0] master, [1] slave
+static map_t *m = &maps[0];                 // device commands go to
+static critical_section_t lock;
+
+void badmap_init(void) {
+    critical_section_init(&lock);
+}
+
+void IDE_HOT(badmap_use)(int dev) {
+    m = &maps[dev ? 1 : 0];
+}
+
+static __force_inline void touch(void) {
+    m->dirty = true;
+    m->changed_us = time_us_32();
+}
+
+// ---------------------------------------------------------------------------
+//  Drive selection / load
+// ---------------------------------------------------------------------------
+
+static int find_slot(const map_t *map) {
+    for (int k = 0; k < BADMAP_SLOTS; k++)
+        if (flash_slots[k].magic == BADMAP_MAGIC &&
+            memcmp(flash_slots[k].serial, map->serial, sizeof(map->serial)) == 0)
+            return k;
+    return -1;
+}
+
+void badmap_select(const uint16_t *id) {
+    // Same drive again: keep what is in RAM, it may not be saved yet
+    if (id && m->keyed && memcmp(m->serial, id + 10, sizeof(m->serial)) == 0) return;
+    // Another drive: save what the last one found before it is dropped
+    if (m->dirty && m->keyed) badmap_service(true);
+
+    critical_section_enter_blocking(&lock);
+    m->n_ext = 0;
+    m->dropped = 0;
+    m->dirty = false;
+    m->keyed = false;
+    memset(m->serial, 0, sizeof(m->serial));
+    if (id) {
+        memcpy(m->serial, id + 10, sizeof(m->serial));
+        for (int i = 0; i < 10; i++)
+            if (m->serial[i] != 0x0000 && m->serial[i] != 0x2020) m->keyed = true;    // blank serial: RAM only
+    }
+    int k = m->keyed ? find_slot(m) : -1;
+    if (k >= 0) {
+        const slot_t *s = &flash_slots[k];
+        uint32_t n = s->count <= BADMAP_MAX ? s->count : 0;
+        for (uint32_t i = 0; i < n; i++) {
+            m->ext[i].lba = ((uint64_t)s->ext[i].lba_hi << 32) | s->ext[i].lba_lo;
+            m->ext[i].len = s->ext[i].len;
+        }
+        m->n_ext = n;
+    }
+    critical_section_exit(&lock);
+}
+
+// ---------------------------------------------------------------------------
+//  Lookup / update
+// ---------------------------------------------------------------------------
+
+bool IDE_HOT(badmap_first)(uint64_t lba, uint32_t count, uint64_t *bad) {
+    if (!m->n_ext) return false;
+    uint64_t end = lba + count;
+    bool hit = false;
+    critical_section_enter_blocking(&lock);
+    for (uint32_t i = 0; i < m->n_ext && m->ext[i].lba < end; i++) {
+        if (m->ext[i].lba + m->ext[i].len > lba) {
+            *bad = m->ext[i].lba > lba ? m->ext[i].lba : lba;
+            hit = true;
+            break;
+        }
+    }
+    critical_section_exit(&lock);
+    return hit;
+}
+
+void badmap_add(uint64_t lba, uint32_t count) {
+    if (!count) return;
+    uint64_t s = lba, e = lba + count;
+    critical_section_enter_blocking(&lock);
+    // Extents overlapping or touching [s, e) are absorbed into one
+    uint32_t i = 0;
+    while (i < m->n_ext && m->ext[i].lba + m->ext[i].len < s) i++;
+    uint32_t j = i;
+    for (; j < m->n_ext && m->ext[j].lba <= e; j++) {
+        if (m->ext[j].lba < s) s = m->ext[j].lba;
+        if (m->ext[j].lba + m->ext[j].len > e) e = m->ext[j].lba + m->ext[j].len;
+    }
+    if (j == i) {
+        if (m->n_ext == BADMAP_MAX) {
+            m->dropped++;
+            critical_section_exit(&lock);
+            return;
+        }
+        ide_memmove(&m->ext[i + 1], &m->ext[i], (m->n_ext - i) * sizeof(m->ext[0]));
+        m->n_ext++;
+    } else {
+        ide_memmove(&m->ext[i + 1], &m->ext[j], (m->n_ext - j) * sizeof(m->ext[0]));
+        m->n_ext -= j - i - 1;
+    }
+    m->ext[i].lba = s;
+    m->ext[i].len = (uint32_t)(e - s);
+    touch();
+    critical_section_exit(&lock);
+}
+
+void IDE_HOT(badmap_remove)(uint64_t lba, uint32_t count) {
+    if (!m->n_ext || !count) return;
+    uint64_t s = lba, e = lba + count;
+    critical_section_enter_blocking(&lock);
+    for (uint32_t i = 0; i < m->n_ext && m->ext[i].lba < e; ) {
+        uint64_t a = m->ext[i].lba, b = a + m->ext[i].len;
+        if (b <= s) { i++; continue; }
+        touch();
+        if (a < s && b > e) {
+            // Hole in the middle; with no room to split, keep it whole
+            if (m->n_ext < BADMAP_MAX) {
+                ide_memmove(&m->ext[i + 1], &m->ext[i], (m->n_ext - i) * sizeof(m->ext[0]));
+                m->n_ext++;
+                m->ext[i].len = (uint32_t)(s - a);
+                m->ext[i + 1].lba = e;
+                m->ext[i + 1].len = (uint32_t)(b - e);
+            }
+            break;
+        }
+        if (a < s) {
+            m->ext[i++].len = (uint32_t)(s - a);
+        } else if (b > e) {
+            m->ext[i].lba = e;
+            m->ext[i++].len = (uint32_t)(b - e);
+        } else {
+            ide_memmove(&m->ext[i], &m->ext[i + 1], (m->n_ext - i - 1) * sizeof(m->ext[0]));
+            m->n_ext--;
+        }
+    }
+    critical_section_exit(&lock);
+}
+
+void badmap_clear(void) {
+    critical_section_enter_blocking(&lock);
+    m->n_ext = 0;
+    m->dropped = 0;
+    touch();
+    critical_section_exit(&lock);
+}
+
+uint32_t badmap_extents(void) { return m->n_ext; }
+uint32_t badmap_dropped(void) { return m->dropped; }
+
+uint64_t badmap_sectors(void) {
+    uint64_t total = 0;
+    critical_section_enter_blocking(&lock);
+    for (uint32_t i = 0; i < m->n_ext; i++) total += m->ext[i].len;
+    critical_section_exit(&lock);
+    return total;
+}
+
+bool badmap_get(uint32_t i, uint64_t *lba, uint32_t *len) {
+    bool ok = false;
+    critical_section_enter_blocking(&lock);
+    if (i < m->n_ext) {
+        *lba = m->ext[i].lba;
+        *len = m->ext[i].len;
+        ok = true;
+    }
+    critical_section_exit(&lock);
+    return ok;
+}
+
+// ---------------------------------------------------------------------------
+//  Flash write — same sequence as config_save()
+// ---------------------------------------------------------------------------
+
+static bool settled(const map_t *map, bool now) {
+    if (!map->dirty || !map->keyed) return false;
+    if (now) return true;
+    uint32_t t = time_us_32();
+    return t - map->changed_us >= BADMAP_SETTLE_MS * 1000 &&
+           t - msc_last_us >= BADMAP_HOST_IDLE_MS * 1000;
+}
+
+void badmap_service(bool now) {
+    if (!settled(&maps[0], now) && !settled(&maps[1], now)) return;
+
+    static slot_t slots[BADMAP_SLOTS];
+    memcpy(slots, flash_slots, sizeof(slots));
+
+    for (int d = 0; d < 2; d++) {
+        map_t *map = &maps[d];
+        if (!settled(map, now)) continue;
+        const map_t *other = &maps[d ^ 1];
+
+        // This drive's slot, else an unused one, else the older one that is
+        // not the other attached drive's
+        int k = find_slot(map);
+        for (int i = 0; k < 0 && i < BADMAP_SLOTS; i++)
+            if (slots[i].magic != BADMAP_MAGIC) k = i;
+        uint32_t seq = 0;
+        for (int i = 0; i < BADMAP_SLOTS; i++)
+            if (slots[i].magic == BADMAP_MAGIC && slots[i].seq >= seq) seq = slots[i].seq + 1;
+        for (int i = 0; k < 0 && i < BADMAP_SLOTS; i++)
+            if (other->keyed && memcmp(slots[i].serial, other->serial, sizeof(other->serial)) == 0)
+                k = i ^ 1;
+        if (k < 0) k = (slots[0].seq <= slots[1].seq) ? 0 : 1;
+
+        slot_t *s = &slots[k];
+        memset(s, 0, sizeof(*s));
+        s->magic = BADMAP_MAGIC;
+        s->seq = seq;
+        critical_section_enter_blocking(&lock);
+        memcpy(s->serial, map->serial, sizeof(map->serial));
+        s->count = (uint16_t)map->n_ext;
+        for (uint32_t i = 0; i < map->n_ext; i++) {
+            s->ext[i].lba_lo = (uint32_t)map->ext[i].lba;
+            s->ext[i].lba_hi = (uint32_t)(map->ext[i].lba >> 32);
+            s->ext[i].len = map->ext[i].len;
+        }
+        map->dirty = false;
+        critical_section_exit(&lock);
+    }
+
+    multicore_lockout_start_blocking();
+    uint32_t ints = save_and_disable_interrupts();
+    flash_range_erase(BADMAP_FLASH_OFFSET, FLASH_SECTOR_SIZE);
+    flash_range_program(BADMAP_FLASH_OFFSET, (const uint8_t *)slots, sizeof(slots));
+    restore_interrupts(ints);
+    multicore_lockout_end_blocking();
+}
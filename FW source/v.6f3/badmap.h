@@ -0,0 +1,40 @@
+#ifndef BADMAP_H
+#define BADMAP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Bad-sector map: sorted, merged extents of LBAs the drive could not read.
+// Master and slave each have a map, keyed by IDENTIFY serial; the calls
+// below act on the one chosen by badmap_use().  Both fit in a spare flash
+// sector, which holds the maps of the last two drives seen.
+// Safe to call from both cores; only badmap_service() writes flash.
+
+#define BADMAP_MAX      168         // extents per drive
+
+void     badmap_init(void);
+// Make the master (0) or slave (1) map current.  Follows device select.
+void     badmap_use(int dev);
+// Load the map stored for this drive (IDENTIFY data), or start an empty
+// one.  NULL: drive without IDENTIFY — map kept in RAM only.  Keeps the
+// map in RAM when it already belongs to this drive.
+void     badmap_select(const uint16_t *id);
+
+// First mapped LBA in [lba, lba + count), if any.
+bool     badmap_first(uint64_t lba, uint32_t count, uint64_t *bad);
+void     badmap_add(uint64_t lba, uint32_t count);
+void     badmap_remove(uint64_t lba, uint32_t count);
+void     badmap_clear(void);
+
+uint32_t badmap_extents(void);
+uint64_t badmap_sectors(void);
+uint32_t badmap_dropped(void);      // additions lost because the map was full
+bool     badmap_get(uint32_t i, uint64_t *lba, uint32_t *len);
+
+// Core 1 only: write the map to flash once it has been unchanged for a
+// few seconds and the host has not read or written for a few more
+// (now = true: if changed at all, for unmount and save).  Pauses core 0
+// briefly, so USB transfers stall for the duration.
+void     badmap_service(bool now);
+
+#endif
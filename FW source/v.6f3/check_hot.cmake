@@ -0,0 +1,72 @@
+# Post-build check: the IDE_HOT code placed in SRAM calls nothing in flash.
+# Every call and tail call in our .time_critical.* sections is looked up
+# in the linked image; a callee in XIP flash fails the build, so a helper
+# that loses its IDE_HOT (or an SDK call that isn't inline) shows up here
+# instead of as XIP misses in Debug X.  Callees reached only after an
+# error or a reset may stay in flash and are listed in COLD_OK.
+#
+#   cmake -DOBJDUMP=<objdump> -DNM=<nm> -DELF=<elf> -DOBJS="<a.obj>|<b.obj>" -P check_hot.cmake
+
+cmake_minimum_required(VERSION 3.13)
+
+set(COLD_OK
+    ide_soft_reset          # timeout recovery
+    restore_device          # after SRST
+    ide_pio_set_mode        # first select after a reset
+    badmap_add              # sector found unreadable
+    tud_msc_set_sense       # failing a command
+)
+
+execute_process(COMMAND ${NM} ${ELF} OUTPUT_VARIABLE nm_out RESULT_VARIABLE rc)
+if (rc)
+    message(FATAL_ERROR "check_hot: ${NM} ${ELF} failed")
+endif()
+string(REPLACE "\n" ";" nm_lines "${nm_out}")
+set(flash_syms "")
+foreach (line IN LISTS nm_lines)
+    if (line MATCHES "^1[0-9a-fA-F]+ [tTwW] (.+)$")
+        list(APPEND flash_syms "${CMAKE_MATCH_1}")
+    endif()
+endforeach()
+
+string(REPLACE "|" ";" OBJS "${OBJS}")
+set(bad "")
+set(checked 0)
+foreach (obj IN LISTS OBJS)
+    if (NOT obj MATCHES "ATAboy\\.dir/[^/]+\\.c\\.o(bj)?$")
+        continue()                          # SDK sources built into the target
+    endif()
+    execute_process(COMMAND ${OBJDUMP} -r ${obj} OUTPUT_VARIABLE rel_out RESULT_VARIABLE rc)
+    if (rc)
+        message(FATAL_ERROR "check_hot: ${OBJDUMP} -r ${obj} failed")
+    endif()
+    string(REPLACE "\n" ";" rel_lines "${rel_out}")
+    set(fn "")
+    foreach (line IN LISTS rel_lines)
+        if (line MATCHES "^RELOCATION RECORDS FOR \\[\\.time_critical\\.(.+)\\]:")
+            set(fn "${CMAKE_MATCH_1}")
+        elseif (line MATCHES "^RELOCATION RECORDS FOR")
+            set(fn "")
+        elseif (fn AND line MATCHES "R_ARM_THM_(CALL|JUMP24|JUMP19) +([^ +]+)")
+            set(callee "${CMAKE_MATCH_2}")
+            math(EXPR checked "${checked} + 1")
+            set(in_flash OFF)
+            if (callee MATCHES "^\\.text\\.(.+)$")          # static callee, by section
+                set(callee "${CMAKE_MATCH_1}")
+                set(in_flash ON)
+            elseif (callee IN_LIST flash_syms)
+                set(in_flash ON)
+            endif()
+            if (in_flash AND NOT callee IN_LIST COLD_OK)
+                list(APPEND bad "${fn} -> ${callee}")
+            endif()
+        endif()
+    endforeach()
+endforeach()
+
+if (bad)
+    list(REMOVE_DUPLICATES bad)
+    string(REPLACE ";" "\n  " bad "${bad}")
+    message(FATAL_ERROR "check_hot: SRAM data path calls into flash:\n  ${bad}")
+endif()
+message(STATUS "check_hot: ${checked} calls from the SRAM data path, none into flash")
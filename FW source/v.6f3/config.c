@@ -1,4 +1,5 @@
 #include "config.h"
+#include "ide.h"
 #include "hardware/flash.h"
 #include "hardware/sync.h"
 #include "pico/multicore.h"
@@ -9,19 +10,25 @@ static const uint8_t *flash_target = (const uint8_t *)(XIP_BASE + FLASH_TARGET_O
 
 config_t config;
 
+_Static_assert(sizeof(config_t) <= FLASH_PAGE_SIZE, "config_t exceeds one flash page");
+
 void config_defaults(void) {
     config.main_selected = 0;
     config.feat_selected = 0;
-    config.drive_write_protected = true;
     config.auto_mount = false;
     config.iordy_enabled = false;
     config.intrq_enabled = false;
-    config.use_lba_mode = false;
-    config.cyls = 0;
-    config.heads = 0;
-    config.spt = 0;
-    config.lba_sectors = 0;
+    memset(config.lun, 0, sizeof(config.lun));
+    for (int i = 0; i < CONFIG_LUNS; i++) {
+        config.lun[i].write_protected = true;
+        config.lun[i].lookahead_keep = true;
+    }
     config.dev_base = 0xA0;
+    config.chs_track_split = false;
+    config.fail_ceiling_ms = 4000;
+    config.retry_known_bad = false;
+    config.write_cache = false;
+    config.lookahead = LOOKAHEAD_AUTO;
 }
 
 void config_load(void) {
@@ -46,3 +53,12 @@ void config_save(void) {
     restore_interrupts(ints);
     multicore_lockout_end_blocking();
 }
+
+lun_config_t *IDE_HOT(config_lun)(uint8_t dev_base) {
+    return &config.lun[dev_base == 0xB0 ? 1 : 0];
+}
+
+uint64_t IDE_HOT(config_lun_sectors)(const lun_config_t *l) {
+    if (l->use_lba_mode) return l->lba_sectors;
+    return (uint64_t)l->cyls * l->heads * l->spt;
+}
@@ -4,22 +4,47 @@
 #include <stdint.h>
 #include <stdbool.h>
 
-#define CONFIG_MAGIC 0x1DE45707
+#define CONFIG_MAGIC 0x1DE45710
+
+// Each drive on the cable is one USB LUN: lun[0] Master, lun[1] Slave
+#define CONFIG_LUNS     2
 
 typedef struct {
-    uint32_t magic;
-    uint8_t  main_selected;
-    uint8_t  feat_selected;
-    bool     drive_write_protected;
-    bool     auto_mount;
-    bool     iordy_enabled;
-    bool     intrq_enabled;
     bool     use_lba_mode;
+    bool     write_protected;
     uint16_t cyls;
     uint8_t  heads;
     uint8_t  spt;
     uint64_t lba_sectors;
-    uint8_t  dev_base;            // 0xA0 = master, 0xB0 = slave
+    bool     lookahead_keep;      // Auto result for lookahead_tag: leave it on
+    uint16_t lookahead_tag;       // ide_identify_tag() of the drive benchmarked here
+    bool     tuned;               // Auto Tune Bus result valid for tune_tag
+    uint8_t  tune_pio_mode;       // fastest error-free PIO mode
+    uint8_t  tune_margin;         // % timing stretch incl. safety margin
+    bool     tune_iordy;          // IORDY / INTRQ the winning run used
+    bool     tune_intrq;
+    uint16_t tune_tag;            // ide_identify_tag() of the drive tuned here
+} lun_config_t;
+
+// config.lookahead
+#define LOOKAHEAD_AUTO  0           // benchmarked once per drive
+#define LOOKAHEAD_ON    1
+#define LOOKAHEAD_OFF   2
+
+typedef struct {
+    uint32_t magic;
+    uint8_t  main_selected;
+    uint8_t  feat_selected;
+    bool     auto_mount;
+    bool     iordy_enabled;       // drives without an Auto Tune result
+    bool     intrq_enabled;
+    lun_config_t lun[CONFIG_LUNS];
+    uint8_t  dev_base;            // drive shown in the menus: 0xA0 = master, 0xB0 = slave
+    bool     chs_track_split;     // CHS: never let one command cross a track
+    uint16_t fail_ceiling_ms;     // longest wait on a read/write before failing it
+    bool     retry_known_bad;     // read sectors in the bad-sector map anyway
+    bool     write_cache;         // drive write cache on (flushed on sync/unmount)
+    uint8_t  lookahead;           // LOOKAHEAD_AUTO / _ON / _OFF
 } config_t;
 
 extern config_t config;
@@ -28,4 +53,9 @@ void config_load(void);
 void config_save(void);
 void config_defaults(void);
 
+// Settings of the drive at dev_base (0xA0 / 0xB0), and its size in
+// sectors from them (0 = no geometry set)
+lun_config_t *config_lun(uint8_t dev_base);
+uint64_t config_lun_sectors(const lun_config_t *l);
+
 #endif
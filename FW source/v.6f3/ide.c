@@ -1,121 +1,561 @@
 #include "ide.h"
 #include "ide_pio.h"
 #include "config.h"
+#include "badmap.h"
 #include "hardware/gpio.h"
-#include "hardware/structs/sio.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
 #include "pico/stdlib.h"
 #include "pico/time.h"
+#include <string.h>
 
 static uint8_t dev_base = 0xA0;   // 0xA0 = master, 0xB0 = slave
+static const lun_config_t *geo = &config.lun[0];    // addressing of dev_base
 
-void ide_select_device(uint8_t base) { dev_base = base; }
+// Sectors per DRQ block for READ/WRITE MULTIPLE; 0 = single-sector commands
+static uint8_t multi_count = 0;
+
+// Write cache (IDENTIFY word 82 bit 5).  wcache_set: our policy was sent
+// with SET FEATURES and is put back after SRST.
+static bool wcache_present = false;
+static bool wcache_on = false;
+static bool wcache_set = false;
+static bool flush_ext = false;          // FLUSH CACHE EXT (LBA48 drives)
+
+// Read look-ahead as last set with SET FEATURES; put back after SRST
+static bool la_set = false;
+static bool la_on = false;
+
+// Cleared when the drive drops BSY before raising DRQ — the read chain
+// can't wait out that gap, so such drives take the per-sector path
+static bool read_chain_ok = true;
+
+// IORDY / INTRQ for this drive: its Auto Tune result, else the Features
+// settings (ide_negotiate_pio_mode)
+static bool iordy_on = false;
+static bool intrq_on = false;
+
+// ---------------------------------------------------------------------------
+//  Command timeouts — budgets learnt from this drive's completions
+// ---------------------------------------------------------------------------
+// A log2 histogram of completion times per class gives the p99; the budget
+// is TO_SCALE times that, between the class floor and the fast-fail
+// ceiling.  The factor leaves room for a drive's own short retries.
+
+#define TO_BUCKETS      24          // bucket k: [2^k, 2^(k+1)) us, up to ~16 s
+#define TO_MIN_SAMPLES  32          // before that the ceiling applies
+#define TO_AGE_SAMPLES  4096        // halve the histogram to follow drift
+#define TO_SCALE        8
+#define TO_SPINUP_MS    10000
+#define TO_IDLE_MS      5000        // shortest standby timer ATA allows
+
+static const uint16_t to_floor_ms[IDE_TO_CLASSES] = { TO_SPINUP_MS, 100, 250, 500 };
+
+typedef struct {
+    uint16_t hist[IDE_TO_CLASSES][TO_BUCKETS];
+    uint16_t n[IDE_TO_CLASSES];
+    uint32_t budget_ms[IDE_TO_CLASSES];     // 0 = not learnt yet
+    uint32_t p99_us[IDE_TO_CLASSES];
+    uint32_t expired[IDE_TO_CLASSES];
+    uint32_t active_hi, active_lo;          // raw timer at the last completion
+} to_state_t;
+
+static to_state_t to;
+
+void ide_timeout_reset(void) {
+    memset(&to, 0, sizeof(to));
+}
+
+static uint32_t IDE_HOT(fail_ceiling_ms)(void) {
+    return config.fail_ceiling_ms ? config.fail_ceiling_ms : 4000;
+}
+
+uint32_t IDE_HOT(ide_timeout_ms)(ide_to_t cls) {
+    if (cls == IDE_TO_SPINUP) return TO_SPINUP_MS;
+    uint32_t ceil = fail_ceiling_ms();
+    uint32_t b = to.budget_ms[cls];
+    return (b && b < ceil) ? b : ceil;
+}
+
+// Idle longer than the shortest standby timer: the drive may have spun
+// down, and the next command waits out a spin-up before it answers.  The
+// high word covers gaps past the 32-bit wrap; reading the two halves
+// apart can only make a gap look longer.
+static bool IDE_HOT(to_idle)(void) {
+    return timer_hw->timerawh != to.active_hi ||
+           timer_hw->timerawl - to.active_lo > TO_IDLE_MS * 1000;
+}
+
+static void IDE_HOT(to_active)(void) {
+    to.active_hi = timer_hw->timerawh;
+    to.active_lo = timer_hw->timerawl;
+}
+
+// Ceiling for a whole request, or the spin-up time if it may wake the drive
+static uint32_t IDE_HOT(wake_ceiling_ms)(void) {
+    return to_idle() ? TO_SPINUP_MS : fail_ceiling_ms();
+}
+
+uint32_t ide_timeout_p99_us(ide_to_t cls) { return to.p99_us[cls]; }
+uint32_t ide_timeout_expired(ide_to_t cls) { return to.expired[cls]; }
+
+// Record one successful completion and refresh the class budget
+static void IDE_HOT(to_record)(ide_to_t cls, uint32_t us) {
+    if (cls == IDE_TO_SPINUP) return;
+    uint16_t *h = to.hist[cls];
+    int k = us ? 31 - __builtin_clz(us) : 0;
+    if (k >= TO_BUCKETS) k = TO_BUCKETS - 1;
+    h[k]++;
+    if (++to.n[cls] >= TO_AGE_SAMPLES) {
+        to.n[cls] = 0;
+        for (int i = 0; i < TO_BUCKETS; i++) { h[i] >>= 1; to.n[cls] += h[i]; }
+    }
+    if (to.n[cls] < TO_MIN_SAMPLES) return;
+
+    // p99 = upper edge of the bucket holding the 99th percentile
+    uint32_t want = to.n[cls] - to.n[cls] / 100, sum = 0;
+    for (k = 0; k < TO_BUCKETS - 1; k++)
+        if ((sum += h[k]) >= want) break;
+    to.p99_us[cls] = 2u << k;
+    uint32_t ms = (to.p99_us[cls] / 1000) * TO_SCALE;
+    to.budget_ms[cls] = ms > to_floor_ms[cls] ? ms : to_floor_ms[cls];
+}
+
+// ---------------------------------------------------------------------------
+//  Shadow taskfile — last values written to registers 1-6
+// ---------------------------------------------------------------------------
+// Registers 1-5 are two deep for LBA48: prev[] is the HOB byte.  A drive
+// may rewrite the address and count when a command completes (older ones
+// report the last sector there), so a register is only trusted for
+// elision once the first few sector commands have read it back unchanged.
+//
+// The address registers 3-6 may hold any sector of the last command's
+// range afterwards (the last, or the one that failed), and a drive that
+// does so only changes the upper ones when a transfer crosses a boundary:
+// a read of 1F8h-207h leaves 02h in register 4, which the early checks
+// (short reads near LBA 0) can't have seen.  So only the address bytes
+// common to the whole range are carried over a sector command.  The
+// DEV/LBA bits of register 6 never change; in LBA48 it has no address
+// bits and is always carried, in LBA28 its low nibble is LBA 24-27.
+
+#define SHADOW_CHECKS   4
+#define SHADOW_ADDR     0x78                // registers 3-6
+
+static struct {
+    uint8_t  cur[7], prev[7];
+    uint8_t  cur_ok, prev_ok;               // bit r: value known
+    uint8_t  trust;                         // bit r: drive leaves it alone
+    uint8_t  checks;                        // read-back checks still to run
+    bool     hob;                           // last command wrote HOB bytes
+    uint32_t elided;
+} shadow = { .trust = 0x7E, .checks = SHADOW_CHECKS };
+
+static void IDE_HOT(shadow_invalidate)(void) {
+    shadow.cur_ok = shadow.prev_ok = 0;
+}
+
+// After a hardware reset, or for a newly selected device: forget the
+// values and what was learnt about the drive
+static void shadow_reset(void) {
+    shadow_invalidate();
+    shadow.trust = 0x7E;
+    shadow.checks = SHADOW_CHECKS;
+}
+
+static void IDE_HOT(shadow_write)(uint8_t reg, uint8_t val) {
+    uint8_t bit = 1u << reg;
+    shadow.prev[reg] = shadow.cur[reg];
+    shadow.prev_ok = (shadow.prev_ok & ~bit) | (shadow.cur_ok & bit);
+    shadow.cur[reg] = val;
+    shadow.cur_ok |= bit;
+}
+
+// Read registers 2-6 (and the HOB bytes if the command wrote them) back
+// after a successful sector command; any register the drive changed is
+// never elided for this drive again
+static void IDE_HOT(shadow_verify)(void) {
+    if (!shadow.checks) return;
+    shadow.checks--;
+    for (int r = 2; r <= 6; r++)
+        if ((shadow.cur_ok & (1u << r)) && ide_read_reg(r) != shadow.cur[r])
+            shadow.trust &= ~(1u << r);
+    if (shadow.hob) {
+        ide_write_control(0x80);            // HOB: read the previous bytes
+        for (int r = 2; r <= 5; r++)
+            if ((shadow.prev_ok & (1u << r)) && ide_read_reg(r) != shadow.prev[r])
+                shadow.trust &= ~(1u << r);
+        ide_write_control(0x00);
+    }
+    shadow_invalidate();                    // nothing elided until verified
+}
+
+uint32_t ide_get_elided(void) { return shadow.elided; }
+
+// ---------------------------------------------------------------------------
+//  Device switch — master and slave keep their own negotiated state
+// ---------------------------------------------------------------------------
+// The two drives share the bus, but each has its own transfer mode,
+// multiple block, cache policy and learnt timeouts.  Those of the device
+// not selected are parked here and put back when it is selected again.
+
+typedef struct {
+    uint8_t    multi_count;
+    bool       wcache_present, wcache_on, wcache_set, flush_ext;
+    bool       la_set, la_on;
+    bool       read_chain_ok;
+    bool       iordy_on, intrq_on;
+    bool       srst_pending;        // SRST sent to the other device reset this one too
+    ide_pio_timing_t pio;
+    uint8_t    shadow_trust, shadow_checks;
+    to_state_t to;
+} dev_state_t;
+
+static dev_state_t devs[2];         // [1] slave; the entry for dev_base is stale
+static ide_bus_t bus;
+
+static __force_inline int dev_index(uint8_t base) { return base == 0xB0 ? 1 : 0; }
+
+static void __noinline restore_device(void);
+
+// gpio_set_inover() without the call into flash: IORDY as the drive drives
+// it, or forced HIGH so the PIO 'wait' never blocks
+static __force_inline void iordy_apply(bool enabled) {
+    hw_write_masked(&io_bank0_hw->io[IDE_IORDY].ctrl,
+                    (enabled ? GPIO_OVERRIDE_NORMAL : GPIO_OVERRIDE_HIGH) << IO_BANK0_GPIO0_CTRL_INOVER_LSB,
+                    IO_BANK0_GPIO0_CTRL_INOVER_BITS);
+}
+
+// What a hardware reset leaves of a device's state
+static void dev_after_reset(dev_state_t *d) {
+    d->multi_count = 0;
+    d->wcache_set = d->la_set = d->srst_pending = false;
+    d->read_chain_ok = true;
+    d->pio.mode = 0;
+    d->pio.div_data = 0;            // recomputed on select
+    d->shadow_trust = 0x7E;
+    d->shadow_checks = SHADOW_CHECKS;
+}
+
+static void IDE_HOT(set_base)(uint8_t base) {
+    dev_base = base;
+    geo = config_lun(base);
+    badmap_use(dev_index(base));
+}
+
+uint8_t ide_get_device(void) { return dev_base; }
+
+void IDE_HOT(ide_select_device)(uint8_t base) {
+    if (base == dev_base) return;
+    dev_state_t *d = &devs[dev_index(dev_base)];
+    d->multi_count = multi_count;
+    d->wcache_present = wcache_present; d->wcache_on = wcache_on;
+    d->wcache_set = wcache_set; d->flush_ext = flush_ext;
+    d->la_set = la_set; d->la_on = la_on;
+    d->read_chain_ok = read_chain_ok;
+    d->iordy_on = iordy_on; d->intrq_on = intrq_on;
+    ide_pio_get_timing(&d->pio);
+    d->shadow_trust = shadow.trust; d->shadow_checks = shadow.checks;
+    d->to = to;
+
+    set_base(base);
+    d = &devs[dev_index(base)];
+    multi_count = d->multi_count;
+    wcache_present = d->wcache_present; wcache_on = d->wcache_on;
+    wcache_set = d->wcache_set; flush_ext = d->flush_ext;
+    la_set = d->la_set; la_on = d->la_on;
+    read_chain_ok = d->read_chain_ok;
+    if (d->iordy_on != iordy_on) iordy_apply(d->iordy_on);
+    iordy_on = d->iordy_on; intrq_on = d->intrq_on;
+    ide_pio_set_timing(&d->pio);
+    shadow.trust = d->shadow_trust; shadow.checks = d->shadow_checks;
+    to = d->to;
+
+    shadow_invalidate();
+    ide_write_reg(6, base);
+    ide_delay_us(1);                // 400 ns before Status is valid
+    if (d->srst_pending) {
+        d->srst_pending = false;
+        restore_device();
+    }
+}
+
+// ---------------------------------------------------------------------------
+//  Bus arbiter — one owner of the taskfile at a time
+// ---------------------------------------------------------------------------
+
+// A mutex_t, but with the inline spin lock calls only: mutex_enter_blocking()
+// runs from flash and this is taken on every USB read and write
+static spin_lock_t *bus_spin;
+static volatile bool bus_owned;
+
+void IDE_HOT(ide_bus_lock)(void) {
+    while (true) {
+        uint32_t save = spin_lock_blocking(bus_spin);
+        bool got = !bus_owned;
+        bus_owned = true;
+        spin_unlock(bus_spin, save);
+        if (got) return;
+        __wfe();                    // woken by the owner's __sev()
+    }
+}
+
+void IDE_HOT(ide_bus_unlock)(void) {
+    uint32_t save = spin_lock_blocking(bus_spin);
+    bus_owned = false;
+    spin_unlock(bus_spin, save);
+    __sev();
+}
 
 // ---------------------------------------------------------------------------
-//  Bus helpers — address, transceiver, and chip-select (all SIO-managed)
+//  Register I/O — single 8-bit reads/writes via the ide_reg state machine
 // ---------------------------------------------------------------------------
 
-static void bus_idle(void) {
-    sio_hw->gpio_set = (1 << IDE_CS0) | (1 << IDE_CS1);
-    sio_hw->gpio_clr = (1 << IDE_DIR) | (1 << IDE_DIR1);   // DIR = read
-    sio_hw->gpio_set = (1 << IDE_OE) | (1 << IDE_OE1);     // OE disabled
+void IDE_HOT(ide_write_reg)(uint8_t reg, uint8_t val) {
+    ide_pio_reg_write(false, reg, val);
+    // Callers time from a command write — make sure it is on the bus
+    if (reg == 7) {
+        ide_pio_reg_flush();
+        shadow_invalidate();                // the command may rewrite the taskfile
+    } else if (reg >= 1 && reg <= 6) {
+        shadow_write(reg, val);
+    }
 }
 
-static void set_address(uint8_t addr) {
-    sio_hw->gpio_clr = ADDR_MASK;
-    sio_hw->gpio_set = (uint32_t)(addr & 0x07) << IDE_A0;
+uint8_t IDE_HOT(ide_read_reg)(uint8_t reg) {
+    return ide_pio_reg_read(false, reg);
 }
 
-static void xcvr_read(void) {
-    sio_hw->gpio_set = (1 << IDE_OE) | (1 << IDE_OE1);     // disable first
-    sio_hw->gpio_clr = (1 << IDE_DIR) | (1 << IDE_DIR1);   // DIR = IDE -> Pico
-    busy_wait_at_least_cycles(20);                            // 74HCT245 switch time
-    sio_hw->gpio_clr = (1 << IDE_OE) | (1 << IDE_OE1);     // enable
+uint8_t IDE_HOT(ide_read_alt_status)(void) {
+    return ide_pio_reg_read(true, 6);
 }
 
-static void xcvr_write(void) {
-    sio_hw->gpio_set = (1 << IDE_OE) | (1 << IDE_OE1);     // disable first
-    sio_hw->gpio_set = (1 << IDE_DIR) | (1 << IDE_DIR1);   // DIR = Pico -> IDE
-    busy_wait_at_least_cycles(20);
-    sio_hw->gpio_clr = (1 << IDE_OE) | (1 << IDE_OE1);     // enable
+void IDE_HOT(ide_write_control)(uint8_t val) {
+    ide_pio_reg_write(true, 6, val);
+    ide_pio_reg_flush();
 }
 
 // ---------------------------------------------------------------------------
-//  Register I/O — single 8-bit reads/writes via PIO strobes
+//  Command images — taskfile + command in one DMA burst
 // ---------------------------------------------------------------------------
 
-void ide_write_reg(uint8_t reg, uint8_t val) {
-    set_address(reg);
-    xcvr_write();
-    sio_hw->gpio_clr = (1 << IDE_CS0);
+void IDE_HOT(ide_cmd_begin)(ide_cmd_t *c) {
+    c->n = 0;
+    c->keep = c->keep_hob = 0;
+}
 
-    uint16_t word = (uint16_t)val;
-    ide_pio_write(1, &word);
+void IDE_HOT(ide_cmd_reg)(ide_cmd_t *c, uint8_t reg, uint8_t val) {
+    if (c->n < IDE_CMD_MAX - 1) {           // last slot reserved for the command
+        c->reg[c->n] = reg;
+        c->val[c->n] = val;
+        c->n++;
+    }
+}
 
-    sio_hw->gpio_set = (1 << IDE_CS0);
-    bus_idle();
+// READ/WRITE SECTORS and MULTIPLE (EXT) — the commands shadow_verify()
+// has checked; anything else may leave the taskfile in any state
+static bool IDE_HOT(is_sector_cmd)(uint8_t command) {
+    switch (command) {
+    case 0x20: case 0x24: case 0x29: case 0xC4:
+    case 0x30: case 0x34: case 0x39: case 0xC5:
+        return true;
+    }
+    return false;
 }
 
-uint8_t ide_read_reg(uint8_t reg) {
-    set_address(reg);
-    xcvr_read();
-    sio_hw->gpio_clr = (1 << IDE_CS0);
+void IDE_HOT(ide_cmd_issue)(ide_cmd_t *c, uint8_t command) {
+    // Drop writes that leave a trusted register as it is.  A register
+    // written twice (HOB, LOB) is kept or dropped as a pair, so the
+    // drive's two-deep register still ends up as HOB behind LOB.
+    bool skip[IDE_CMD_MAX] = {false};
+    bool elide = !shadow.checks;
+    shadow.hob = false;
+    for (int i = 0; i < c->n; i++) {
+        uint8_t r = c->reg[i], bit = 1u << r;
+        int k = -1;
+        for (int j = 0; j < c->n; j++)
+            if (j != i && c->reg[j] == r) { k = j; break; }
+        if (k >= 0) shadow.hob = true;
+        if (!elide || !(shadow.trust & bit)) continue;
+        if (k < 0)
+            skip[i] = (shadow.cur_ok & bit) && shadow.cur[r] == c->val[i];
+        else if (k > i)
+            skip[i] = skip[k] = (shadow.prev_ok & bit) && (shadow.cur_ok & bit) &&
+                                shadow.prev[r] == c->val[i] && shadow.cur[r] == c->val[k];
+    }
+
+    uint32_t word[IDE_CMD_MAX];
+    uint32_t n = 0;
+    for (int i = 0; i < c->n; i++) {
+        if (skip[i]) { shadow.elided++; continue; }
+        word[n++] = ide_pio_reg_word(false, c->reg[i], c->val[i]);
+        shadow_write(c->reg[i], c->val[i]);
+    }
+    word[n++] = ide_pio_reg_word(false, 7, command);
+    ide_pio_reg_burst(word, n);
+
+    if (!is_sector_cmd(command)) {
+        shadow_invalidate();
+    } else {
+        shadow.cur_ok &= ~SHADOW_ADDR | c->keep;
+        shadow.prev_ok &= ~SHADOW_ADDR | c->keep_hob;
+    }
+}
 
-    uint16_t val;
-    ide_pio_read(1, &val);
+// Registers 3-5 whose byte (from bit 'shift' up) is the same for every
+// sector first..last, so whichever one the drive reports leaves them be
+static __force_inline uint8_t addr_fixed(uint64_t first, uint64_t last, int shift) {
+    uint8_t m = 0;
+    for (int r = 3; r <= 5; r++, shift += 8)
+        if ((first >> shift) == (last >> shift)) m |= 1u << r;
+    return m;
+}
 
-    sio_hw->gpio_set = (1 << IDE_CS0);
-    bus_idle();
-    return (uint8_t)(val & 0xFF);
+// Sector count + LBA.  Returns true when the command needs LBA48, in which
+// case the caller must issue the EXT form.  That is decided per command:
+// only transfers that reach past LBA28 or move more than 256 sectors pay
+// for the four HOB writes.  count is 1-256 (LBA28) or 1-65536 (LBA48);
+// the top value is written as 0.
+static bool IDE_HOT(cmd_lba)(ide_cmd_t *c, uint64_t lba, uint32_t count) {
+    uint64_t last = lba + count - 1;
+    c->keep = addr_fixed(lba, last, 0);
+    if (lba + count > 0x0FFFFFFF || count > 256) {
+        c->keep |= 0x40;
+        c->keep_hob = addr_fixed(lba, last, 24);
+        // LBA48: HOB (high bytes) first, then LOB (low bytes)
+        ide_cmd_reg(c, 2, (count >> 8) & 0xFF);                // sector count high
+        ide_cmd_reg(c, 3, (lba >> 24) & 0xFF);                 // LBA 24-31
+        ide_cmd_reg(c, 4, (lba >> 32) & 0xFF);                 // LBA 32-39
+        ide_cmd_reg(c, 5, (lba >> 40) & 0xFF);                 // LBA 40-47
+        ide_cmd_reg(c, 2, count & 0xFF);                       // sector count low
+        ide_cmd_reg(c, 3, lba & 0xFF);                         // LBA 0-7
+        ide_cmd_reg(c, 4, (lba >> 8) & 0xFF);                  // LBA 8-15
+        ide_cmd_reg(c, 5, (lba >> 16) & 0xFF);                 // LBA 16-23
+        ide_cmd_reg(c, 6, dev_base | 0x40);                    // LBA mode, no address bits
+        return true;
+    }
+    if ((lba >> 24) == (last >> 24)) c->keep |= 0x40;
+    ide_cmd_reg(c, 2, count & 0xFF);
+    ide_cmd_reg(c, 3, lba & 0xFF);
+    ide_cmd_reg(c, 4, (lba >> 8) & 0xFF);
+    ide_cmd_reg(c, 5, (lba >> 16) & 0xFF);
+    ide_cmd_reg(c, 6, (dev_base | 0x40) | ((lba >> 24) & 0x0F));
+    return false;
 }
 
-uint8_t ide_read_alt_status(void) {
-    set_address(6);
-    xcvr_read();
-    sio_hw->gpio_clr = (1 << IDE_CS1);
+static void IDE_HOT(cmd_chs)(ide_cmd_t *c, uint16_t cyl, uint8_t head, uint8_t sec, uint8_t count) {
+    ide_cmd_reg(c, 2, count);
+    ide_cmd_reg(c, 3, sec);                                    // 1-based
+    ide_cmd_reg(c, 4, cyl & 0xFF);
+    ide_cmd_reg(c, 5, (cyl >> 8) & 0xFF);
+    ide_cmd_reg(c, 6, dev_base | (head & 0x0F));
+}
 
-    uint16_t val;
-    ide_pio_read(1, &val);
+// ---------------------------------------------------------------------------
+//  Transfer splitter — one request, as few commands as the taskfile allows
+// ---------------------------------------------------------------------------
 
-    sio_hw->gpio_set = (1 << IDE_CS1);
-    bus_idle();
-    return (uint8_t)(val & 0xFF);
+// Position of the next chunk.  CHS is derived once per request and then
+// stepped, not re-divided for every chunk.
+typedef struct {
+    uint64_t lba;
+    uint16_t cyl;
+    uint8_t  head;
+    uint8_t  sec;                           // 1-based
+} xfer_pos_t;
+
+static void IDE_HOT(pos_init)(xfer_pos_t *p, uint64_t lba) {
+    p->lba = lba;
+    if (geo->use_lba_mode) return;
+    uint32_t tmp = (uint32_t)lba / geo->spt;                // CHS stays below 2^24
+    p->sec  = ((uint32_t)lba % geo->spt) + 1;
+    p->head = tmp % geo->heads;
+    p->cyl  = tmp / geo->heads;
 }
 
-void ide_write_control(uint8_t val) {
-    set_address(6);
-    xcvr_write();
-    sio_hw->gpio_clr = (1 << IDE_CS1);
+static void IDE_HOT(pos_advance)(xfer_pos_t *p, uint32_t n) {
+    p->lba += n;
+    if (geo->use_lba_mode) return;
+    uint32_t sec = p->sec - 1 + n;
+    while (sec >= geo->spt) {
+        sec -= geo->spt;
+        if (++p->head == geo->heads) { p->head = 0; p->cyl++; }
+    }
+    p->sec = (uint8_t)(sec + 1);
+}
 
-    uint16_t word = (uint16_t)val;
-    ide_pio_write(1, &word);
+// Sectors for the next command: the taskfile count limit, rounded to whole
+// multiple blocks, and optionally cut at the end of the current CHS track
+static uint32_t IDE_HOT(chunk_len)(const xfer_pos_t *p, uint32_t left) {
+    uint32_t n = (geo->use_lba_mode && geo->lba_sectors > 0x0FFFFFFF) ? 65536 : 256;
+    uint32_t per = multi_count ? multi_count : 1;
+    n -= n % per;
+    if (!geo->use_lba_mode && config.chs_track_split) {
+        uint32_t track_left = geo->spt - (p->sec - 1);
+        if (n > track_left) n = track_left;
+    }
+    return left < n ? left : n;
+}
 
-    sio_hw->gpio_set = (1 << IDE_CS1);
-    bus_idle();
+// Address for READ/WRITE SECTORS in the configured translation mode
+static bool IDE_HOT(cmd_sectors)(ide_cmd_t *c, const xfer_pos_t *p, uint32_t count) {
+    if (geo->use_lba_mode)
+        return cmd_lba(c, p->lba, count);
+    cmd_chs(c, p->cyl, p->head, p->sec, (uint8_t)count);
+    return false;
 }
 
+// ---------------------------------------------------------------------------
+//  INTRQ — GPIO 28 rising edge wakes the waiting core
+// ---------------------------------------------------------------------------
+
+#define INTRQ_FALLBACK_MS   20      // Alt Status check if INTRQ doesn't come
+
+static volatile bool intrq_flag = false;
+static uint32_t intrq_missed = 0;
+
+static void IDE_HOT(intrq_irq_handler)(void) {
+    if (gpio_get_irq_event_mask(IDE_INTRQ) & GPIO_IRQ_EDGE_RISE) {
+        // gpio_acknowledge_irq() without the call into flash
+        io_bank0_hw->intr[IDE_INTRQ / 8] = GPIO_IRQ_EDGE_RISE << 4 * (IDE_INTRQ % 8);
+        intrq_flag = true;
+        __sev();                    // either core may be the one waiting
+    }
+}
+
+// ---------------------------------------------------------------------------
+//  Bus init, resets and probing
+// ---------------------------------------------------------------------------
+
 void ide_set_iordy(bool enabled) {
-    gpio_set_inover(IDE_IORDY, enabled ? GPIO_OVERRIDE_NORMAL : GPIO_OVERRIDE_HIGH);
+    iordy_apply(enabled);
 }
 
+void ide_set_handshake(bool iordy, bool intrq) {
+    iordy_on = iordy;
+    intrq_on = intrq;
+    iordy_apply(iordy);
+}
+
+bool ide_get_iordy(void) { return iordy_on; }
+bool ide_get_intrq(void) { return intrq_on; }
+
 // ---------------------------------------------------------------------------
 //  Init / Reset / Polling
 // ---------------------------------------------------------------------------
 
 void ide_hw_init(void) {
-    // SIO-controlled output pins
-    uint32_t sio_out = (1 << IDE_DIR) | (1 << IDE_DIR1) |
-                       (1 << IDE_OE)  | (1 << IDE_OE1)  |
-                       ADDR_MASK |
-                       (1 << IDE_RESET) |
-                       (1 << IDE_CS0) | (1 << IDE_CS1);
-
-    gpio_init_mask(sio_out);
-    gpio_set_dir_out_masked(sio_out);
+    // RESET is the only SIO-controlled output; PIO owns the rest of the bus
+    gpio_init(IDE_RESET);
+    gpio_put(IDE_RESET, 1);
+    gpio_set_dir(IDE_RESET, GPIO_OUT);
 
     // INTRQ — active-high from drive, idle low
     gpio_init(IDE_INTRQ);
     gpio_set_dir(IDE_INTRQ, GPIO_IN);
     gpio_pull_down(IDE_INTRQ);
+    gpio_add_raw_irq_handler(IDE_INTRQ, intrq_irq_handler);
+    gpio_set_irq_enabled(IDE_INTRQ, GPIO_IRQ_EDGE_RISE, true);
+    irq_set_enabled(IO_IRQ_BANK0, true);
 
     // IORDY — active-high when ready, pulled up as fallback
     gpio_init(IDE_IORDY);
@@ -129,96 +569,511 @@ void ide_hw_init(void) {
 
     // Bring up PIO state machines
     ide_pio_init();
-
-    gpio_put(IDE_RESET, 1);
-    bus_idle();
+    bus_spin = spin_lock_init(spin_lock_claim_unused(true));
 
     // nIEN=0: allow INTRQ from the drive
     ide_write_control(0x00);
 
     // Restore IORDY based on config (override was HIGH for safe init)
-    ide_set_iordy(config.iordy_enabled);
+    ide_set_handshake(config.iordy_enabled, config.intrq_enabled);
+}
+
+// Spin-up: every step polls the taskfile against its own deadline, so a
+// drive that is already spinning is ready as soon as its POST is done
+// rather than after a fixed delay.
+#define RESET_PULSE_US      1000    // RESET- low; ATA asks for 25 us
+#define RESET_SETTLE_US     2000    // no Status read this soon after RESET-
+#define RESET_PRESENT_MS    5000    // configured drive may still be powering up
+#define PROBE_PRESENT_MS    2000    // floating bus for this long: no device
+#define DRDY_MS             1000    // after BSY, for drives with a signature
+
+typedef enum {
+    SPIN_SELECT,            // until the bus stops floating (FFh, or 7Fh with DD7 pulled down)
+    SPIN_BUSY,              // POST and spin-up: until BSY clears
+    SPIN_SIGNATURE,         // ATA / ATAPI signature from the reset
+    SPIN_DRDY,              // until DRDY, if the drive left a signature
+    SPIN_RECAL,             // RECALIBRATE, required by some pre-ATA drives
+    SPIN_READY,
+    SPIN_ABSENT
+} spin_state_t;
+
+static void reset_pulse(void) {
+    gpio_put(IDE_RESET, 0);
+    busy_wait_us_32(RESET_PULSE_US);
+    gpio_put(IDE_RESET, 1);
+    busy_wait_us_32(RESET_SETTLE_US);
+    ide_write_control(0x00);                // nIEN=0
+}
+
+// Walk one device from reset towards 'until'.  The device must show up on
+// the bus by present_by.  Returns 'until' once reached, SPIN_ABSENT, or for
+// SPIN_READY: SPIN_RECAL when BSY cleared but DRDY never came (early
+// drives before INITIALIZE DRIVE PARAMETERS).
+static spin_state_t spin_up(uint8_t base, absolute_time_t present_by, spin_state_t until) {
+    spin_state_t state = SPIN_SELECT;
+    absolute_time_t deadline = present_by;
+    uint8_t st = 0xFF;
+    while (state != until) {
+        switch (state) {
+        case SPIN_SELECT:
+            ide_write_reg(6, base);
+            busy_wait_us_32(50);            // let selection settle
+            st = ide_read_reg(7);
+            if (st != 0xFF && st != 0x7F) {
+                state = SPIN_BUSY;
+                deadline = make_timeout_time_ms(ide_timeout_ms(IDE_TO_SPINUP));
+            } else if (time_reached(deadline)) {
+                return SPIN_ABSENT;
+            } else {
+                busy_wait_us_32(1000);
+            }
+            break;
+
+        case SPIN_BUSY:
+            st = ide_read_reg(7);
+            if (!(st & 0x80)) state = SPIN_SIGNATURE;
+            else if (time_reached(deadline)) return SPIN_ABSENT;
+            else busy_wait_us_32(100);
+            break;
+
+        case SPIN_SIGNATURE:
+            // Count/Number 01h/01h from the reset; cylinder 14h/EBh is ATAPI
+            if (ide_read_reg(4) == 0x14 && ide_read_reg(5) == 0xEB) return SPIN_ABSENT;
+            if (ide_read_reg(2) == 0x01 && ide_read_reg(3) == 0x01) {
+                state = SPIN_DRDY;
+                deadline = make_timeout_time_ms(DRDY_MS);
+            } else {
+                state = SPIN_RECAL;         // pre-ATA: no signature to go by
+            }
+            break;
+
+        case SPIN_DRDY:
+            st = ide_read_reg(7);
+            if ((st & 0xC0) == 0x40 || time_reached(deadline)) state = SPIN_RECAL;
+            else busy_wait_us_32(100);
+            break;
+
+        case SPIN_RECAL:
+            ide_write_reg(6, base);
+            ide_write_reg(7, 0x10);
+            return ide_wait_until_ready(ide_timeout_ms(IDE_TO_SPINUP)) ? SPIN_READY : SPIN_RECAL;
+
+        default:
+            return state;
+        }
+    }
+    return state;
 }
 
-void ide_reset_drive(void) {
+bool ide_reset_drive(void) {
     // Force IORDY HIGH during reset — drive holds it LOW during POST
     ide_set_iordy(false);
+    // Hardware reset returns the drive to its default transfer mode
+    ide_pio_set_mode(0);
+    ide_pio_bus_idle();
+    read_chain_ok = true;
+    multi_count = 0;                        // hardware reset drops multiple mode
+    wcache_set = false;                     // ...and the cache settings
+    la_set = false;
+    shadow_reset();
+    dev_after_reset(&devs[dev_index(dev_base) ^ 1]);   // RESET- reaches both devices
+
+    reset_pulse();
+    bool ready = spin_up(dev_base, make_timeout_time_ms(RESET_PRESENT_MS), SPIN_READY) == SPIN_READY;
+
+    // Restore this drive's IORDY setting — ready for normal operation
+    ide_set_iordy(iordy_on);
+    return ready;
+}
 
-    gpio_put(IDE_RESET, 0);
-    sleep_ms(50);
-    gpio_put(IDE_RESET, 1);
-    sleep_ms(100);
-    ide_write_control(0x00);
-    ide_wait_until_ready(10000);
+// ---------------------------------------------------------------------------
+//  Discovery — EXECUTE DEVICE DIAGNOSTIC (0x90), both devices in one pass
+// ---------------------------------------------------------------------------
+// After the reset, device 0 holds BSY until device 1 has reported its POST
+// over PDIAG-, and EXECUTE DEVICE DIAGNOSTIC does the same for the
+// diagnostic, so one wait covers both drives.  Results are cached until
+// the next probe.
+
+#define DIAG_MS             6000    // device 0 waits up to 5 s for device 1
+
+// After diagnostics device 1 answers for itself; without a device 1,
+// device 0 answers its Status reads with 00h
+static bool slave_answers(void) {
+    ide_write_reg(6, 0xB0);
+    busy_wait_us_32(50);
+    uint8_t st = ide_read_reg(7);
+    return st != 0x00 && st != 0xFF && st != 0x7F;
+}
 
-    // Recalibrate — seek heads to track 0 (required by some pre-ATA drives)
-    ide_write_reg(6, dev_base);
-    ide_write_reg(7, 0x10);
-    ide_wait_until_ready(10000);
+static uint8_t discover(absolute_time_t present_by) {
+    uint8_t mask = 0;
+    if (spin_up(0xA0, present_by, SPIN_SIGNATURE) == SPIN_ABSENT) {
+        // No device 0 — a drive jumpered as device 1 can still be alone
+        if (spin_up(0xB0, present_by, SPIN_SIGNATURE) != SPIN_ABSENT) mask |= IDE_DEV_SLAVE;
+        return mask;
+    }
+    mask |= IDE_DEV_MASTER;
 
-    // Restore IORDY to config setting — drive is ready for normal operation
-    ide_set_iordy(config.iordy_enabled);
+    ide_write_reg(6, 0xA0);
+    ide_write_reg(7, 0x90);
+    busy_wait_us_32(1);             // give drive time to assert BSY
+    int st = ide_pio_poll(false, DIAG_MS * 1000);
+    if (st >= 0) {
+        bus.diag = ide_read_reg(1);
+        bus.diag_ok = true;
+        if (slave_answers()) mask |= IDE_DEV_SLAVE;
+    } else if (spin_up(0xB0, present_by, SPIN_SIGNATURE) != SPIN_ABSENT && slave_answers()) {
+        mask |= IDE_DEV_SLAVE;      // diagnostic never finished: look directly
+    }
+    return mask;
 }
 
 uint8_t ide_probe_devices(void) {
     ide_set_iordy(false);
+    ide_pio_set_mode(0);
+    ide_pio_bus_idle();
+    read_chain_ok = true;
+    multi_count = 0;
+    wcache_present = wcache_on = wcache_set = false;
+    la_set = false;
+    shadow_reset();
+    ide_timeout_reset();
+    memset(devs, 0, sizeof(devs));
+    for (int i = 0; i < 2; i++) {
+        dev_after_reset(&devs[i]);
+        devs[i].iordy_on = config.iordy_enabled;    // until negotiated
+        devs[i].intrq_on = config.intrq_enabled;
+    }
+    iordy_on = config.iordy_enabled;
+    intrq_on = config.intrq_enabled;
+    // The first probe after boot may find the drive still powering up
+    uint32_t present_ms = bus.probed ? PROBE_PRESENT_MS : RESET_PRESENT_MS;
+    memset(&bus, 0, sizeof(bus));
+    bus.probed = true;
 
     // Single hardware reset — both devices see it
-    gpio_put(IDE_RESET, 0);
-    sleep_ms(50);
-    gpio_put(IDE_RESET, 1);
-    sleep_ms(2000);           // generous POST delay (not status-based)
-    ide_write_control(0x00);  // nIEN=0
+    reset_pulse();
+    uint8_t mask = discover(make_timeout_time_ms(present_ms));
 
+    // Present = BSY clears (not DRDY; some older drives won't assert DRDY
+    // until after INITIALIZE DRIVE PARAMETERS).  ATAPI devices are dropped.
     static const uint8_t addrs[] = {0xA0, 0xB0};
     for (int i = 0; i < 2; i++) {
-        ide_write_reg(6, addrs[i]);       // select device
-        busy_wait_us_32(50);              // let selection settle
-
-        // Floating bus filter: 0xFF means no device (bus floats high)
-        uint8_t st = ide_read_reg(7);
-        if (st == 0xFF) continue;
-
-        // Device present — wait for BSY to clear (not DRDY; some older
-        // drives won't assert DRDY until after INITIALIZE DRIVE PARAMETERS)
-        dev_base = addrs[i];
-        uint32_t start = to_ms_since_boot(get_absolute_time());
-        bool bsy_clear = false;
-        while (to_ms_since_boot(get_absolute_time()) - start < 10000) {
-            st = ide_read_reg(7);
-            if (!(st & 0x80)) { bsy_clear = true; break; }
-            busy_wait_us_32(10);
-        }
-        if (!bsy_clear) continue;
+        if (!(mask & (1u << i))) continue;
+        set_base(addrs[i]);
+        if (spin_up(addrs[i], get_absolute_time(), SPIN_READY) == SPIN_ABSENT) continue;
+        bus.present |= (uint8_t)(1u << i);
+        bus.id_valid[i] = ide_identify(bus.id[i]);
+    }
 
-        // Recalibrate (required by some pre-ATA drives)
-        ide_write_reg(6, addrs[i]);
-        ide_write_reg(7, 0x10);
-        ide_wait_until_ready(10000);
+    ide_set_iordy(iordy_on);
+    return ide_discovered_base();
+}
 
-        ide_set_iordy(config.iordy_enabled);
-        return addrs[i];
-    }
+const ide_bus_t *ide_get_bus(void) { return &bus; }
 
-    ide_set_iordy(config.iordy_enabled);
-    return 0;  // no device found
+const uint16_t *ide_cached_identify(uint8_t base) {
+    int i = dev_index(base);
+    return bus.id_valid[i] ? bus.id[i] : NULL;
 }
 
-bool ide_wait_until_ready(uint32_t timeout_ms) {
-    uint32_t start = to_ms_since_boot(get_absolute_time());
-    while (to_ms_since_boot(get_absolute_time()) - start < timeout_ms) {
-        uint8_t st = ide_read_reg(7);
-        if (!(st & 0x80) && (st & 0x40)) return true;   // BSY=0, DRDY=1
-        busy_wait_us_32(10);
+// The last drive used if it is still there, else the first one found
+uint8_t ide_discovered_base(void) {
+    if (bus.present & (1u << dev_index(config.dev_base))) return config.dev_base;
+    if (bus.present & IDE_DEV_MASTER) return 0xA0;
+    if (bus.present & IDE_DEV_SLAVE) return 0xB0;
+    return 0;
+}
+
+bool IDE_HOT(ide_wait_until_ready)(uint32_t timeout_ms) {
+    uint32_t end = ide_deadline_us(timeout_ms * 1000);
+    while (!ide_deadline_reached(end)) {
+        int st = ide_pio_poll(false, ide_deadline_left_us(end));       // waits until BSY=0
+        if (st < 0) return false;
+        if (st & 0x40) return true;                     // BSY=0, DRDY=1
+        ide_delay_us(10);
     }
     return false;
 }
 
+// Status once BSY clears, or -1 after timeout_ms.  With want_drq, keep
+// waiting while the drive shows BSY=0 but neither DRQ nor ERR yet (some
+// early drives drop BSY a moment before raising DRQ).  alt polls Alt
+// Status, which leaves INTRQ pending.
+static int IDE_HOT(wait_status)(uint32_t timeout_ms, bool want_drq, bool alt) {
+    uint32_t end = ide_deadline_us(timeout_ms * 1000);
+    do {
+        int st = ide_pio_poll(alt, ide_deadline_left_us(end));
+        if (st < 0) return -1;
+        if (!want_drq || (st & 0x09)) return st;
+        ide_delay_us(1);
+    } while (!ide_deadline_reached(end));
+    return -1;
+}
+
+// Sleep until INTRQ, then read Status once (which drops INTRQ).  Every
+// INTRQ_FALLBACK_MS without one, Alt Status is checked so a drive with a
+// flaky INTRQ line still completes; those are counted in intrq_missed.
+static int IDE_HOT(wait_intrq)(uint32_t timeout_ms, bool want_drq) {
+    uint32_t end = ide_deadline_us(timeout_ms * 1000);
+    uint32_t tick = ide_deadline_us(INTRQ_FALLBACK_MS * 1000);
+    while (true) {
+        if (intrq_flag || gpio_get(IDE_INTRQ)) {
+            intrq_flag = false;
+            uint8_t st = ide_read_reg(7);
+            if (!(st & 0x80) && (!want_drq || (st & 0x09))) return st;
+            continue;               // stale edge from an earlier command
+        }
+        if (ide_deadline_reached(end)) return -1;
+        if (ide_deadline_reached(tick)) {
+            uint8_t st = ide_read_alt_status();
+            if (!(st & 0x80) && (!want_drq || (st & 0x09))) {
+                intrq_missed++;
+                return ide_read_reg(7);
+            }
+            tick = ide_deadline_us(INTRQ_FALLBACK_MS * 1000);
+        }
+        ide_pio_sleep_until((int32_t)(tick - end) < 0 ? tick : end);
+    }
+}
+
+// Wait for a state change the drive announces with INTRQ (command done,
+// next DRQ block ready): the GPIO IRQ if INTRQ is enabled, else the PIO
+// poller
+static int IDE_HOT(wait_done)(uint32_t timeout_ms, bool want_drq) {
+    if (intrq_on) return wait_intrq(timeout_ms, want_drq);
+    return wait_status(timeout_ms, want_drq, false);
+}
+
+uint32_t ide_get_intrq_missed(void) { return intrq_missed; }
+
+// wait_done() against the class budget — or the poller when the drive
+// raises no INTRQ for this wait.  Clean completions feed the histogram.
+static int IDE_HOT(wait_timed)(ide_to_t cls, bool want_drq, bool poller) {
+    uint32_t t0 = time_us_32();
+    bool idle = to_idle();                  // a spin-up isn't a sample
+    uint32_t ms = idle ? TO_SPINUP_MS : ide_timeout_ms(cls);
+    int st = poller ? wait_status(ms, want_drq, false) : wait_done(ms, want_drq);
+    if (st < 0) { to.expired[cls]++; return st; }
+    to_active();
+    if (!(st & 0x01) && !idle) to_record(cls, time_us_32() - t0);
+    return st;
+}
+
 bool ide_set_geometry(uint8_t heads, uint8_t spt) {
-    ide_write_reg(6, dev_base | ((heads - 1) & 0x0F));
-    ide_write_reg(2, spt);
-    ide_write_reg(7, 0x91);
-    return ide_wait_until_ready(1000);
+    ide_cmd_t c;
+    ide_cmd_begin(&c);
+    ide_cmd_reg(&c, 6, dev_base | ((heads - 1) & 0x0F));
+    ide_cmd_reg(&c, 2, spt);
+    ide_cmd_issue(&c, 0x91);
+    return ide_wait_until_ready(ide_timeout_ms(IDE_TO_SEEK));
+}
+
+bool ide_set_features(uint8_t feature, uint8_t count) {
+    ide_cmd_t c;
+    ide_cmd_begin(&c);
+    ide_cmd_reg(&c, 1, feature);
+    ide_cmd_reg(&c, 2, count);
+    ide_cmd_reg(&c, 6, dev_base);
+    ide_cmd_issue(&c, 0xEF);
+    busy_wait_us_32(1);             // give drive time to assert BSY
+    if (!ide_wait_until_ready(ide_timeout_ms(IDE_TO_SEEK))) return false;
+    return !(ide_read_reg(7) & 0x01);
+}
+
+// ---------------------------------------------------------------------------
+//  PIO mode negotiation — IDENTIFY words 51, 53, 64, 67, 68
+// ---------------------------------------------------------------------------
+
+static const uint16_t pio_cycle_ns[5] = {600, 383, 240, 180, 120};
+
+uint8_t ide_best_pio_mode(const uint16_t *id, bool iordy) {
+    // Word 51 bits 15:8 — legacy PIO timing mode (0-2 only)
+    uint8_t mode = (id[51] >> 8) & 0xFF;
+    if (mode > 2) mode = 2;
+
+    // Word 53 bit 1 — words 64-70 valid
+    if (id[53] & 0x0002) {
+        // Modes 3-4 need IORDY flow control
+        if (iordy) {
+            if (id[64] & 0x0002)      mode = 4;
+            else if (id[64] & 0x0001) mode = 3;
+        }
+
+        // Minimum cycle time: word 68 with IORDY flow control, word 67 without
+        uint16_t min_cycle = iordy ? id[68] : id[67];
+        while (mode > 0 && min_cycle > pio_cycle_ns[mode]) mode--;
+    }
+    return mode;
+}
+
+uint16_t ide_identify_tag(const uint16_t *id) {
+    uint16_t tag = 0;
+    for (int i = 10; i < 20; i++) tag = (uint16_t)((tag << 1) | (tag >> 15)) ^ id[i];   // serial
+    for (int i = 27; i < 47; i++) tag = (uint16_t)((tag << 1) | (tag >> 15)) ^ id[i];   // model
+    return tag ? tag : 1;
+}
+
+uint8_t ide_negotiate_pio_mode(const uint16_t *id) {
+    // Auto Tune Bus result for this drive in this position: IORDY/INTRQ as
+    // it passed, a cap on the mode and its timing margin
+    const lun_config_t *l = geo;
+    bool tuned = l->tuned && l->tune_tag == ide_identify_tag(id);
+    ide_set_handshake(tuned ? l->tune_iordy : config.iordy_enabled,
+                      tuned ? l->tune_intrq : config.intrq_enabled);
+
+    uint8_t mode = ide_best_pio_mode(id, iordy_on);
+    uint8_t margin = 0;
+    if (tuned) {
+        if (mode > l->tune_pio_mode) mode = l->tune_pio_mode;
+        margin = l->tune_margin;
+    }
+
+    // SET FEATURES 03h: PIO flow-control transfer mode.  Pre-ATA-2 drives
+    // abort this but still honour their word 51 timing; modes 3-4 are only
+    // used if the drive accepts them.  A refused mode 3-4 drops to the
+    // word 51 mode, told to the drive again since it may take that one.
+    if (mode > 2 && !ide_set_features(0x03, 0x08 | mode)) {
+        mode = (id[51] >> 8) & 0xFF;
+        if (mode > 2) mode = 2;
+    }
+    if (mode > 0 && mode <= 2)
+        ide_set_features(0x03, 0x08 | mode);
+
+    ide_pio_set_margin(margin);
+    ide_pio_set_mode(mode);
+    return mode;
+}
+
+// ---------------------------------------------------------------------------
+//  READ/WRITE MULTIPLE — IDENTIFY words 47, 59
+// ---------------------------------------------------------------------------
+
+bool ide_set_multiple(uint8_t count) {
+    ide_cmd_t c;
+    ide_cmd_begin(&c);
+    ide_cmd_reg(&c, 2, count);
+    ide_cmd_reg(&c, 6, dev_base);
+    ide_cmd_issue(&c, 0xC6);
+    busy_wait_us_32(1);             // give drive time to assert BSY
+    if (!ide_wait_until_ready(ide_timeout_ms(IDE_TO_SEEK))) return false;
+    return !(ide_read_reg(7) & 0x01);
+}
+
+uint8_t ide_negotiate_multiple(const uint16_t *id) {
+    // Word 47 bits 7:0 — maximum sectors per DRQ block (0 = not supported).
+    // Take the largest power of two within it; early drives reject others.
+    uint8_t max = id[47] & 0xFF;
+    uint8_t n = 0;
+    if (max) {
+        n = 128;
+        while (n > max) n >>= 1;
+    }
+    // Drives that abort SET MULTIPLE stay on single-sector commands
+    while (n > 1 && !ide_set_multiple(n)) n >>= 1;
+    multi_count = (n > 1) ? n : 0;
+    return multi_count;
+}
+
+uint8_t ide_get_multiple(void) { return multi_count; }
+
+// ---------------------------------------------------------------------------
+//  Write cache and read look-ahead — IDENTIFY words 82, 83, 85
+// ---------------------------------------------------------------------------
+
+#define FLUSH_TIMEOUT_MS    20000   // a full cache, inside the host's own timeout
+
+bool ide_set_write_cache(const uint16_t *id, bool enable) {
+    // Words 82-84 are only meaningful when word 83 reads 01b in bits 15:14
+    bool valid = (id[83] & 0xC000) == 0x4000;
+    wcache_present = valid && (id[82] & 0x0020);
+    flush_ext = valid && (id[83] & 0x2400) == 0x2400;     // LBA48 + FLUSH CACHE EXT
+    wcache_set = false;
+    if (!wcache_present) {
+        wcache_on = false;
+        return false;
+    }
+    if (!enable && wcache_on) ide_flush_cache();
+    // SET FEATURES 02h / 82h: enable / disable write cache
+    if (ide_set_features(enable ? 0x02 : 0x82, 0)) {
+        wcache_on = enable;
+        wcache_set = true;
+    } else {
+        wcache_on = (id[85] & 0x0020) != 0;                 // drive keeps its default
+    }
+    return wcache_on;
+}
+
+bool ide_get_write_cache(void) { return wcache_on; }
+
+// SET FEATURES AAh / 55h: read look-ahead on / off
+bool ide_set_lookahead(bool enable) {
+    la_set = false;
+    if (!ide_set_features(enable ? 0xAA : 0x55, 0)) return false;
+    la_on = enable;
+    la_set = true;
+    return true;
+}
+
+bool ide_get_lookahead(void) { return la_set && la_on; }
+
+bool ide_flush_cache(void) {
+    if (!wcache_present) return true;       // nothing held back
+    if (!ide_wait_until_ready(fail_ceiling_ms())) return false;
+    ide_cmd_t c;
+    ide_cmd_begin(&c);
+    ide_cmd_reg(&c, 6, dev_base);
+    ide_cmd_issue(&c, flush_ext ? 0xEA : 0xE7);
+    busy_wait_us_32(1);             // give drive time to assert BSY
+
+    int st = wait_done(FLUSH_TIMEOUT_MS, false);
+    if (st < 0) {
+        ide_soft_reset();
+        return false;
+    }
+    return !(st & 0x01);
+}
+
+// ---------------------------------------------------------------------------
+//  Soft reset (SRST) — abort a stuck command and restore drive state
+// ---------------------------------------------------------------------------
+
+// Put back what SRST may have dropped, for the selected device
+static void __noinline restore_device(void) {
+    // SRST leaves device 0 selected; a drive that is still BSY may ignore
+    // the select, so check it took once the bus is ready
+    for (int i = 0; i < 2; i++) {
+        ide_write_reg(6, dev_base);
+        busy_wait_us_32(1);             // 400 ns before Status is valid
+        ide_wait_until_ready(fail_ceiling_ms());
+        if ((ide_read_reg(6) & 0x10) == (dev_base & 0x10)) break;
+    }
+    // SRST clears INITIALIZE DRIVE PARAMETERS — restore CHS geometry
+    if (!geo->use_lba_mode && geo->spt)
+        ide_set_geometry(geo->heads, geo->spt);
+    // ...and may revert the transfer mode to the power-on default
+    if (ide_pio_get_mode() > 0)
+        ide_set_features(0x03, 0x08 | ide_pio_get_mode());
+    // Some drives also drop the multiple block size
+    if (multi_count && !ide_set_multiple(multi_count))
+        multi_count = 0;
+    // ...and, with reverting to defaults enabled, the write cache setting
+    if (wcache_set)
+        ide_set_features(wcache_on ? 0x02 : 0x82, 0);
+    if (la_set)
+        ide_set_features(la_on ? 0xAA : 0x55, 0);
+}
+
+void ide_soft_reset(void) {
+    shadow_invalidate();                    // SRST reloads the taskfile defaults
+    ide_write_control(0x04);
+    busy_wait_us_32(10);
+    ide_write_control(0x00);
+    busy_wait_us_32(2000);                  // Status is not valid for 2 ms after SRST
+    restore_device();
+    // SRST resets both devices; the other one is restored when next selected
+    int other = dev_index(dev_base) ^ 1;
+    if (bus.present & (1u << other)) devs[other].srst_pending = true;
 }
 
 // ---------------------------------------------------------------------------
@@ -226,32 +1081,21 @@ bool ide_set_geometry(uint8_t heads, uint8_t spt) {
 // ---------------------------------------------------------------------------
 
 bool ide_identify(uint16_t *buf) {
-    if (!ide_wait_until_ready(1000)) return false;
+    if (!ide_wait_until_ready(ide_timeout_ms(IDE_TO_SEEK))) return false;
     if (ide_read_reg(7) & 0x08) ide_drain_sector();   // drain stranded DRQ before command
-    ide_write_reg(6, dev_base);
-    ide_write_reg(7, 0xEC);
+    ide_cmd_t c;
+    ide_cmd_begin(&c);
+    ide_cmd_reg(&c, 6, dev_base);
+    ide_cmd_issue(&c, 0xEC);
     busy_wait_us_32(1);             // give drive time to assert BSY
 
-    // Poll for DRQ — INTRQ provides early-exit if enabled, otherwise pure polling
-    for (uint32_t t = 0; t < 100000; t++) {
-        if (config.intrq_enabled && gpio_get(IDE_INTRQ)) ide_read_reg(7);  // clear INTRQ
-        uint8_t st = ide_read_reg(7);
-        if (st & 0x01) { if (st & 0x08) ide_drain_sector(); return false; }  // ERR — drain stranded DRQ
-        if (!(st & 0x80) && (st & 0x08)) goto ready;     // BSY=0, DRQ=1
-        busy_wait_us_32(50);
-    }
-    return false;
+    // INTRQ or the PIO poller wakes us on BSY=0 (reading Status clears INTRQ)
+    int st = wait_timed(IDE_TO_SEEK, true, false);
+    if (st < 0) return false;
+    if (st & 0x01) { if (st & 0x08) ide_drain_sector(); return false; }  // ERR — drain stranded DRQ
 
-ready:
     // Burst-read 256 words through PIO
-    set_address(0);
-    xcvr_read();
-    sio_hw->gpio_clr = (1 << IDE_CS0);
-
     ide_pio_read(256, buf);
-
-    sio_hw->gpio_set = (1 << IDE_CS0);
-    bus_idle();
     return true;
 }
 
@@ -259,182 +1103,434 @@ ready:
 //  Drain one sector of DRQ data (discard 256 words)
 // ---------------------------------------------------------------------------
 
-void ide_drain_sector(void) {
+void IDE_HOT(ide_drain_sector)(void) {
     uint16_t discard[256];
-    set_address(0);
-    xcvr_read();
-    sio_hw->gpio_clr = (1 << IDE_CS0);
     ide_pio_read(256, discard);
-    sio_hw->gpio_set = (1 << IDE_CS0);
-    bus_idle();
 }
 
 // ---------------------------------------------------------------------------
-//  Sector I/O — LBA28, single-sector loop
+//  WRITE BUFFER (0xE8) / READ BUFFER (0xE4) — sector buffer round trip
 // ---------------------------------------------------------------------------
 
-int32_t ide_read_sectors(uint32_t lba, uint32_t count, uint8_t *buf) {
-    if (count == 0) return -1;
-    if (!ide_wait_until_ready(5000)) return -1;
-
-    bool use_lba48 = config.use_lba_mode && (config.lba_sectors > 0x0FFFFFFF);
-
-    if (config.use_lba_mode) {
-        if (use_lba48) {
-            // LBA48: HOB (high bytes) first, then LOB (low bytes)
-            ide_write_reg(2, 0);                               // sector count high
-            ide_write_reg(3, (lba >> 24) & 0xFF);              // LBA 24-31
-            ide_write_reg(4, 0);                               // LBA 32-39 (0 for uint32_t)
-            ide_write_reg(5, 0);                               // LBA 40-47 (0 for uint32_t)
-            ide_write_reg(2, (uint8_t)count);                  // sector count low
-            ide_write_reg(3, lba & 0xFF);                      // LBA 0-7
-            ide_write_reg(4, (lba >> 8) & 0xFF);               // LBA 8-15
-            ide_write_reg(5, (lba >> 16) & 0xFF);              // LBA 16-23
-            ide_write_reg(6, dev_base | 0x40);                 // LBA mode, no address bits
-        } else {
-            ide_write_reg(2, (uint8_t)count);
-            ide_write_reg(3, lba & 0xFF);
-            ide_write_reg(4, (lba >> 8) & 0xFF);
-            ide_write_reg(5, (lba >> 16) & 0xFF);
-            ide_write_reg(6, (dev_base | 0x40) | ((lba >> 24) & 0x0F));
+// Poll for BSY=0, DRQ=1.  *intrq (optional) records whether INTRQ was
+// asserted by the time DRQ was seen.
+static bool poll_drq(bool *intrq) {
+    int st = wait_status(ide_timeout_ms(IDE_TO_SEEK), true, true);   // Alt Status: INTRQ stays up
+    if (st < 0) return false;
+    if (intrq) *intrq = gpio_get(IDE_INTRQ);
+    ide_read_reg(7);                            // acknowledge INTRQ
+    if (st & 0x01) { if (st & 0x08) ide_drain_sector(); return false; }
+    return true;
+}
+
+int32_t ide_buffer_loopback(const uint16_t *out, uint16_t *in, bool *intrq_seen) {
+    if (!ide_wait_until_ready(ide_timeout_ms(IDE_TO_SEEK))) return -1;
+
+    ide_write_reg(6, dev_base);
+    ide_write_reg(7, 0xE8);                 // WRITE BUFFER
+    busy_wait_us_32(1);
+    if (!poll_drq(NULL)) return -1;         // no INTRQ before first PIO-out block
+
+    ide_pio_write(256, out);
+
+    if (!ide_wait_until_ready(ide_timeout_ms(IDE_TO_WRITE)) || (ide_read_reg(7) & 0x01)) return -1;
+
+    ide_write_reg(6, dev_base);
+    ide_write_reg(7, 0xE4);                 // READ BUFFER
+    busy_wait_us_32(1);
+    if (!poll_drq(intrq_seen)) return -1;
+
+    ide_pio_read(256, in);
+
+    int32_t bad = 0;
+    for (int i = 0; i < 256; i++) if (in[i] != out[i]) bad++;
+    return bad;
+}
+
+// ---------------------------------------------------------------------------
+//  Sector I/O — one DRQ block per sector, or per multi_count sectors
+// ---------------------------------------------------------------------------
+
+// DMA read path: the PIO poller and a chained DMA walk 'blocks' DRQ blocks
+// of 'per' sectors without the CPU.  1 = done, 0 = drive needs the
+// per-block path (command aborted, caller re-issues), -1 = timeout,
+// -2 = ERR.  *good is the number of blocks that came in before the failure.
+static int IDE_HOT(read_chain)(uint32_t blocks, uint32_t per, uint16_t *wbuf, uint32_t *good) {
+    uint8_t st[IDE_PIO_CHAIN_MAX];
+    *good = 0;
+    // The whole command fails within the fast-fail ceiling, however many
+    // blocks it chains
+    bool idle = to_idle();
+    uint32_t end = ide_deadline_us((idle ? TO_SPINUP_MS : fail_ceiling_ms()) * 1000);
+    for (uint32_t b = 0; b < blocks; b += IDE_PIO_CHAIN_MAX) {
+        uint32_t n = blocks - b;
+        if (n > IDE_PIO_CHAIN_MAX) n = IDE_PIO_CHAIN_MAX;
+        uint32_t left = ide_deadline_left_us(end) / 1000;
+        if (!left) left = 1;
+        uint32_t ms = idle ? left : ide_timeout_ms(IDE_TO_READ) * n;
+        if (ms > left) ms = left;
+        uint32_t t0 = time_us_32();
+        ide_pio_read_chain_start(n, per * 256, wbuf + b * per * 256);
+        if (ide_pio_read_chain_wait(st, ms) < 0) {
+            to.expired[IDE_TO_READ]++;
+            return -1;
         }
-    } else {
-        uint32_t tmp  = lba / config.spt;
-        uint8_t  sec  = (lba % config.spt) + 1;           // 1-based
-        uint8_t  head = tmp % config.heads;
-        uint16_t cyl  = tmp / config.heads;
-        ide_write_reg(2, (uint8_t)count);
-        ide_write_reg(3, sec);
-        ide_write_reg(4, cyl & 0xFF);
-        ide_write_reg(5, (cyl >> 8) & 0xFF);
-        ide_write_reg(6, dev_base | (head & 0x0F));
+        for (uint32_t i = 0; i < n; i++) {
+            if (st[i] & 0x01) {                             // ERR
+                *good = b + i;
+                return -2;
+            }
+            if (!(st[i] & 0x08)) {                          // BSY=0 ahead of DRQ
+                read_chain_ok = false;
+                return 0;
+            }
+        }
+        *good = b + n;
+        to_active();
+        if (idle) { idle = false; continue; }
+        // Blocks aren't timed one by one here: learn from the average
+        uint32_t us = (time_us_32() - t0) / n;
+        for (uint32_t i = 0; i < n; i++) to_record(IDE_TO_READ, us);
     }
+    return 1;
+}
 
-    ide_write_reg(7, use_lba48 ? 0x24 : 0x20);            // READ SECTORS EXT / READ SECTORS
+// A drive that advertises multiple mode but aborts READ/WRITE MULTIPLE:
+// drop back to single-sector commands.  Checked before the soft reset,
+// which would clear the Error register.
+static bool IDE_HOT(multiple_refused)(void) {
+    if (!multi_count || !(ide_read_reg(1) & 0x04)) return false;       // ABRT
+    multi_count = 0;
+    return true;
+}
 
-    uint16_t *wbuf = (uint16_t *)buf;
+// Error register bits for a sector the media can't deliver: BBK, UNC,
+// IDNF, AMNF.  The drive ends the command there and is not hung.  Only
+// BBK and UNC (IDE_ERR_UNREADABLE) say the sector itself is bad; IDNF and
+// AMNF also come from marginal bus timing, so they are not mapped.
+#define ERR_MEDIA   0xD1
+
+// After ERR: drain whatever DRQ data the drive still offers for the
+// failing block, then true if it reported a media error and is idle
+static bool IDE_HOT(media_error_settled)(uint32_t per) {
+    uint8_t err = ide_read_reg(1);
+    for (uint32_t i = 0; i < per && (ide_read_alt_status() & 0x88) == 0x08; i++)
+        ide_drain_sector();
+    return (err & ERR_MEDIA) && !(ide_read_alt_status() & 0x88);
+}
 
-    for (uint32_t s = 0; s < count; s++) {
-        // Poll for DRQ — INTRQ provides early-exit if enabled, otherwise pure polling
-        for (uint32_t t = 0; t < 100000; t++) {
-            if (config.intrq_enabled && gpio_get(IDE_INTRQ)) ide_read_reg(7);  // clear INTRQ
-            uint8_t st = ide_read_reg(7);
-            if (st & 0x01) goto read_err;
-            if (!(st & 0x80) && (st & 0x08)) goto drq_read;
-            busy_wait_us_32(10);
+// One READ command of up to chunk_len() sectors.  0 = done.  On failure
+// the first *good sectors of wbuf are valid (whole blocks), and the drive
+// was left either idle after a media error (-1, no reset needed) or
+// soft-reset after a timeout or other failure (-2).
+static int IDE_HOT(read_cmd)(const xfer_pos_t *p, uint32_t count, uint16_t *wbuf, uint32_t *good) {
+    int st;
+retry:
+    *good = 0;
+    if (!ide_wait_until_ready(fail_ceiling_ms())) return -2;
+
+    uint32_t per = multi_count ? multi_count : 1;
+    ide_cmd_t c;
+    ide_cmd_begin(&c);
+    bool use_lba48 = cmd_sectors(&c, p, count);
+    if (multi_count) ide_cmd_issue(&c, use_lba48 ? 0x29 : 0xC4);     // READ MULTIPLE (EXT)
+    else             ide_cmd_issue(&c, use_lba48 ? 0x24 : 0x20);     // READ SECTORS (EXT)
+
+    // Whole blocks through the chain, a short last block below
+    uint32_t s = 0;
+    if (read_chain_ok && ide_pio_get_dma() && ((uintptr_t)wbuf & 3) == 0) {
+        uint32_t blocks;
+        int r = read_chain(count / per, per, wbuf, &blocks);
+        if (r < 0) {
+            *good = blocks * per;
+            st = (r == -2) ? 0x01 : -1;
+            goto read_err;
         }
-        goto read_err;
-
-    drq_read:
-        set_address(0);
-        xcvr_read();
-        sio_hw->gpio_clr = (1 << IDE_CS0);
+        if (r == 0) {
+            // Chain read ran ahead of DRQ — abort and redo this command per block
+            ide_soft_reset();
+            goto retry;
+        }
+        s = (count / per) * per;
+    }
 
-        ide_pio_read(256, wbuf + s * 256);
+    for (; s < count; s += per) {
+        uint32_t n = count - s;
+        if (n > per) n = per;
+        // Sleep until INTRQ or the PIO poller shows BSY=0 (Status read clears INTRQ)
+        st = wait_timed(IDE_TO_READ, true, false);
+        if (st < 0 || (st & 0x01)) {
+            *good = s;
+            goto read_err;
+        }
 
-        sio_hw->gpio_set = (1 << IDE_CS0);
-        bus_idle();
+        ide_pio_read(n * 256, wbuf + s * 256);
     }
 
-    return (int32_t)(count * 512);
+    shadow_verify();
+    return 0;
 
 read_err:
+    shadow_invalidate();
+    if (multiple_refused()) {
+        ide_soft_reset();
+        goto retry;
+    }
+    if (st >= 0 && media_error_settled(per)) return -1;
     // Soft-reset to abort any stuck command (drive may be retrying internally)
-    ide_write_control(0x04);
-    busy_wait_us_32(10);
-    ide_write_control(0x00);
-    ide_wait_until_ready(2000);
-    // SRST clears INITIALIZE DRIVE PARAMETERS — restore CHS geometry
-    if (!config.use_lba_mode)
-        ide_set_geometry(config.heads, config.spt);
-    return -1;
+    ide_soft_reset();
+    return -2;
 }
 
-int32_t ide_write_sectors(uint32_t lba, uint32_t count, const uint8_t *buf) {
-    if (count == 0) return -1;
-    if (!ide_wait_until_ready(5000)) return -1;
-
-    bool use_lba48 = config.use_lba_mode && (config.lba_sectors > 0x0FFFFFFF);
-
-    if (config.use_lba_mode) {
-        if (use_lba48) {
-            ide_write_reg(2, 0);                               // sector count high
-            ide_write_reg(3, (lba >> 24) & 0xFF);              // LBA 24-31
-            ide_write_reg(4, 0);                               // LBA 32-39
-            ide_write_reg(5, 0);                               // LBA 40-47
-            ide_write_reg(2, (uint8_t)count);                  // sector count low
-            ide_write_reg(3, lba & 0xFF);                      // LBA 0-7
-            ide_write_reg(4, (lba >> 8) & 0xFF);               // LBA 8-15
-            ide_write_reg(5, (lba >> 16) & 0xFF);              // LBA 16-23
-            ide_write_reg(6, dev_base | 0x40);                 // LBA mode, no address bits
-        } else {
-            ide_write_reg(2, (uint8_t)count);
-            ide_write_reg(3, lba & 0xFF);
-            ide_write_reg(4, (lba >> 8) & 0xFF);
-            ide_write_reg(5, (lba >> 16) & 0xFF);
-            ide_write_reg(6, (dev_base | 0x40) | ((lba >> 24) & 0x0F));
+// One WRITE command of up to chunk_len() sectors.  On failure *good is
+// the sectors the drive took before the failing block: it reports a write
+// error when asking for the next block, or at the final commit.
+static int IDE_HOT(write_cmd)(const xfer_pos_t *p, uint32_t count, const uint16_t *wbuf, uint32_t *good) {
+retry:
+    *good = 0;
+    if (!ide_wait_until_ready(fail_ceiling_ms())) return -1;
+
+    uint32_t per = multi_count ? multi_count : 1;
+    ide_cmd_t c;
+    ide_cmd_begin(&c);
+    bool use_lba48 = cmd_sectors(&c, p, count);
+    if (multi_count) ide_cmd_issue(&c, use_lba48 ? 0x39 : 0xC5);     // WRITE MULTIPLE (EXT)
+    else             ide_cmd_issue(&c, use_lba48 ? 0x34 : 0x30);     // WRITE SECTORS (EXT)
+
+    bool write_ok = true;
+
+    for (uint32_t s = 0; s < count; s += per) {
+        uint32_t n = count - s;
+        if (n > per) n = per;
+        // Sleep until BSY=0 with DRQ.  No INTRQ precedes the first block of
+        // a PIO write, so that one always goes to the poller.
+        int st = wait_timed(IDE_TO_WRITE, true, s == 0);
+        if (st < 0 || (st & 0x01)) { write_ok = false; break; }
+
+        ide_pio_write(n * 256, wbuf + s * 256);
+        *good = s;
+    }
+
+    // Wait for drive to commit the last block to media (BSY=0)
+    if (write_ok) {
+        int st = wait_timed(IDE_TO_WRITE, false, false);
+        if (st >= 0 && !(st & 0x01)) {
+            shadow_verify();
+            return 0;
         }
-    } else {
-        uint32_t tmp  = lba / config.spt;
-        uint8_t  sec  = (lba % config.spt) + 1;
-        uint8_t  head = tmp % config.heads;
-        uint16_t cyl  = tmp / config.heads;
-        ide_write_reg(2, (uint8_t)count);
-        ide_write_reg(3, sec);
-        ide_write_reg(4, cyl & 0xFF);
-        ide_write_reg(5, (cyl >> 8) & 0xFF);
-        ide_write_reg(6, dev_base | (head & 0x0F));
     }
 
-    ide_write_reg(7, use_lba48 ? 0x34 : 0x30);            // WRITE SECTORS EXT / WRITE SECTORS
+    shadow_invalidate();
+    if (multiple_refused()) {
+        ide_soft_reset();
+        goto retry;
+    }
+    // Soft-reset to abort any stuck command (drive may be retrying internally)
+    ide_soft_reset();
+    return -1;
+}
 
-    const uint16_t *wbuf = (const uint16_t *)buf;
+// ---------------------------------------------------------------------------
+//  Read error isolation — keep the good sectors, pin down the bad ones
+// ---------------------------------------------------------------------------
+// Also holds the outcome of the last write, which is not retried.
 
-    bool write_ok = true;
+static ide_xfer_err_t xfer_err;
+static uint32_t isolate_end;            // isolation gives up after the fast-fail ceiling
 
-    for (uint32_t s = 0; s < count; s++) {
-        // Poll for DRQ — INTRQ not asserted for first sector of PIO write per ATA spec;
-        // for s > 0 it provides early-exit if enabled, otherwise pure polling
-        bool got_drq = false;
-        for (uint32_t t = 0; t < 100000; t++) {
-            if (s > 0 && config.intrq_enabled && gpio_get(IDE_INTRQ)) ide_read_reg(7);
-            uint8_t st = ide_read_reg(7);
-            if (st & 0x01) { write_ok = false; break; }
-            if (!(st & 0x80) && (st & 0x08)) { got_drq = true; break; }
-            busy_wait_us_32(10);
-        }
-        if (!write_ok || !got_drq) { write_ok = false; break; }
+static void IDE_HOT(mark_bad)(uint64_t lba, uint8_t err, uint16_t *wbuf, uint32_t n) {
+    if (!xfer_err.bad) {
+        xfer_err.first_bad = lba;
+        xfer_err.error = err;
+    }
+    xfer_err.bad += n;
+    ide_memset(wbuf, 0, n * 512);
+    if (err & IDE_ERR_UNREADABLE) badmap_add(lba, n);
+}
 
-        set_address(0);
-        xcvr_write();
-        sio_hw->gpio_clr = (1 << IDE_CS0);
+// Split a failed range in halves and re-read each until the unreadable
+// sectors are single ones.  'failed' skips re-reading the whole range.
+// False if the drive stopped responding or time ran out.
+static bool IDE_HOT(read_bisect)(const xfer_pos_t *p, uint32_t n, uint16_t *wbuf, bool failed) {
+    if (!failed) {
+        uint32_t good;
+        int r = read_cmd(p, n, wbuf, &good);
+        if (r == 0) return true;
+        if (r < -1) { mark_bad(p->lba, 0, wbuf, 0); return false; }
+    }
+    if (n == 1) {
+        mark_bad(p->lba, ide_read_reg(1), wbuf, 1);
+        return true;
+    }
+    if (ide_deadline_reached(isolate_end)) return false;
+    uint32_t h = n / 2;
+    xfer_pos_t q = *p;
+    if (!read_bisect(&q, h, wbuf, false)) return false;
+    pos_advance(&q, h);
+    return read_bisect(&q, n - h, wbuf + h * 256, false);
+}
 
-        ide_pio_write(256, wbuf + s * 256);
+int32_t IDE_HOT(ide_read_sectors)(uint64_t lba, uint32_t count, uint8_t *buf) {
+    if (count == 0) return -1;
+    uint16_t *wbuf = (uint16_t *)buf;
 
-        sio_hw->gpio_set = (1 << IDE_CS0);
-        bus_idle();
+    // Mapped bad sectors fail at once: read only what comes before them
+    uint64_t bad;
+    if (!config.retry_known_bad && badmap_first(lba, count, &bad)) {
+        uint32_t n = (uint32_t)(bad - lba);
+        if (n && ide_read_sectors(lba, n, buf) < 0) return -1;
+        xfer_err = (ide_xfer_err_t){ .good = n, .first_bad = bad, .mapped = true };
+        return -1;
     }
 
-    // Wait for drive to commit the last sector to media (BSY=0)
-    if (write_ok) {
-        for (uint32_t t = 0; t < 100000; t++) {
-            if (config.intrq_enabled && gpio_get(IDE_INTRQ)) ide_read_reg(7);
-            uint8_t st = ide_read_reg(7);
-            if (st & 0x01) { write_ok = false; break; }
-            if (!(st & 0x80)) return (int32_t)(count * 512);
-            busy_wait_us_32(10);
+    xfer_err = (ide_xfer_err_t){ .good = count, .complete = true };
+    bool isolating = false;
+    xfer_pos_t p;
+    pos_init(&p, lba);
+    for (uint32_t done = 0; done < count; ) {
+        uint32_t n = chunk_len(&p, count - done);
+        uint32_t good;
+        int r = read_cmd(&p, n, wbuf + done * 256, &good);
+        if (r == 0) {
+            pos_advance(&p, n);
+            done += n;
+            continue;
+        }
+
+        // Keep the blocks that came in, then isolate the failing block
+        // and carry on with the rest of the request after it
+        pos_advance(&p, good);
+        done += good;
+        if (!isolating) {
+            isolating = true;
+            isolate_end = ide_deadline_us(fail_ceiling_ms() * 1000);
+            xfer_err.first_bad = p.lba;     // until a sector is pinned down
+        }
+        uint32_t blk = multi_count ? multi_count : 1;
+        if (blk > count - done) blk = count - done;
+        if (r < -1) mark_bad(p.lba, 0, wbuf + done * 256, 0);   // hung: don't retry
+        if (r < -1 || !read_bisect(&p, blk, wbuf + done * 256, true)) {
+            xfer_err.complete = false;
+            break;
+        }
+        pos_advance(&p, blk);
+        done += blk;
+        if (done < count && ide_deadline_reached(isolate_end)) {
+            xfer_err.complete = false;
+            break;
         }
     }
+    if (xfer_err.bad || !xfer_err.complete) {
+        uint64_t good = xfer_err.first_bad - lba;
+        xfer_err.good = good < count ? (uint32_t)good : count;
+        return -1;
+    }
+    if (config.retry_known_bad) badmap_remove(lba, count);     // read fine this time
+    return (int32_t)(count * 512);
+}
 
-    // Soft-reset to abort any stuck command (drive may be retrying internally)
-    ide_write_control(0x04);
-    busy_wait_us_32(10);
+int32_t IDE_HOT(ide_write_sectors)(uint64_t lba, uint32_t count, const uint8_t *buf) {
+    if (count == 0) return -1;
+    const uint16_t *wbuf = (const uint16_t *)buf;
+    xfer_pos_t p;
+    pos_init(&p, lba);
+    for (uint32_t done = 0; done < count; ) {
+        uint32_t n = chunk_len(&p, count - done);
+        uint32_t good;
+        if (write_cmd(&p, n, wbuf + done * 256, &good) < 0) {
+            xfer_err = (ide_xfer_err_t){ .good = done + good, .first_bad = lba + done + good };
+            return -1;
+        }
+        pos_advance(&p, n);
+        done += n;
+    }
+    xfer_err = (ide_xfer_err_t){ .good = count, .complete = true };
+    badmap_remove(lba, count);              // rewritten (or reallocated) by the drive
+    return (int32_t)(count * 512);
+}
+
+void IDE_HOT(ide_get_xfer_error)(ide_xfer_err_t *out) { *out = xfer_err; }
+
+// Loop distribution would turn these back into library calls
+void __attribute__((optimize("no-tree-loop-distribute-patterns")))
+IDE_HOT(ide_memmove)(void *dst, const void *src, uint32_t n) {
+    uint8_t *d = dst;
+    const uint8_t *s = src;
+    if (d < s) {
+        while (n--) *d++ = *s++;
+    } else {
+        d += n;
+        s += n;
+        while (n--) *--d = *--s;
+    }
+}
+
+void __attribute__((optimize("no-tree-loop-distribute-patterns")))
+IDE_HOT(ide_memset)(void *dst, uint8_t val, uint32_t n) {
+    uint8_t *d = dst;
+    while (n--) *d++ = val;
+}
+
+// Diagnostics and tuning: the same commands without the bad-sector map or
+// isolation, so a failure caused by the timing under test marks nothing
+int32_t IDE_HOT(ide_read_sectors_raw)(uint64_t lba, uint32_t count, uint8_t *buf) {
+    if (count == 0) return -1;
+    uint16_t *wbuf = (uint16_t *)buf;
+    xfer_pos_t p;
+    pos_init(&p, lba);
+    for (uint32_t done = 0; done < count; ) {
+        uint32_t n = chunk_len(&p, count - done);
+        uint32_t good;
+        if (read_cmd(&p, n, wbuf + done * 256, &good) != 0) return -1;
+        pos_advance(&p, n);
+        done += n;
+    }
+    return (int32_t)(count * 512);
+}
+
+// ---------------------------------------------------------------------------
+//  READ VERIFY SECTORS (0x40 / 0x42) — media check, no data on the bus
+// ---------------------------------------------------------------------------
+
+// Sector a failed command stopped at, from the taskfile address
+static uint64_t error_lba(bool lba48) {
+    if (!geo->use_lba_mode) {
+        uint32_t cyl = ide_read_reg(4) | ((uint32_t)ide_read_reg(5) << 8);
+        uint8_t head = ide_read_reg(6) & 0x0F, sec = ide_read_reg(3);
+        return ((uint64_t)cyl * geo->heads + head) * geo->spt + (sec ? sec - 1 : 0);
+    }
+    uint64_t v = ide_read_reg(3) | ((uint32_t)ide_read_reg(4) << 8) | ((uint32_t)ide_read_reg(5) << 16);
+    if (!lba48) return v | (uint64_t)(ide_read_reg(6) & 0x0F) << 24;
+    ide_write_control(0x80);                // HOB: LBA 24-47
+    v |= (uint64_t)ide_read_reg(3) << 24 | (uint64_t)ide_read_reg(4) << 32 |
+         (uint64_t)ide_read_reg(5) << 40;
     ide_write_control(0x00);
-    ide_wait_until_ready(2000);
-    // SRST clears INITIALIZE DRIVE PARAMETERS — restore CHS geometry
-    if (!config.use_lba_mode)
-        ide_set_geometry(config.heads, config.spt);
-    return -1;
+    return v;
+}
+
+int ide_verify_sectors(uint64_t lba, uint32_t count, uint64_t *bad, uint8_t *err) {
+    if (count == 0 || count > 256) return -2;
+    if (!ide_wait_until_ready(fail_ceiling_ms())) return -2;
+    xfer_pos_t p;
+    pos_init(&p, lba);
+    ide_cmd_t c;
+    ide_cmd_begin(&c);
+    bool use_lba48 = cmd_sectors(&c, &p, count);
+    ide_cmd_issue(&c, use_lba48 ? 0x42 : 0x40);    // READ VERIFY SECTORS (EXT)
+    busy_wait_us_32(1);             // give drive time to assert BSY
+
+    // The drive works through the whole range before it answers
+    int st = wait_done(wake_ceiling_ms() + count, false);
+    if (st >= 0) to_active();
+    if (st >= 0 && !(st & 0x01)) return 0;
+    *err = st >= 0 ? ide_read_reg(1) : 0;
+    if ((*err & ERR_MEDIA) && !(ide_read_alt_status() & 0x88)) {
+        uint64_t at = error_lba(use_lba48);
+        *bad = (at >= lba && at < lba + count) ? at : lba;
+        return -1;
+    }
+    ide_soft_reset();
+    return -2;
 }
 
 // ---------------------------------------------------------------------------
@@ -446,42 +1542,15 @@ void ide_read_taskfile(uint8_t tf[8]) {
 }
 
 uint8_t ide_seek_read_one(uint32_t target, bool lba) {
-    bool use_lba48 = lba && (config.lba_sectors > 0x0FFFFFFF);
-
-    if (lba) {
-        if (use_lba48) {
-            ide_write_reg(2, 0);                                   // sector count high
-            ide_write_reg(3, (target >> 24) & 0xFF);               // LBA 24-31
-            ide_write_reg(4, 0);                                   // LBA 32-39
-            ide_write_reg(5, 0);                                   // LBA 40-47
-            ide_write_reg(2, 1);                                   // sector count low
-            ide_write_reg(3, target & 0xFF);                       // LBA 0-7
-            ide_write_reg(4, (target >> 8) & 0xFF);                // LBA 8-15
-            ide_write_reg(5, (target >> 16) & 0xFF);               // LBA 16-23
-            ide_write_reg(6, dev_base | 0x40);                     // LBA mode
-        } else {
-            ide_write_reg(2, 1);
-            ide_write_reg(3, target & 0xFF);
-            ide_write_reg(4, (target >> 8) & 0xFF);
-            ide_write_reg(5, (target >> 16) & 0xFF);
-            ide_write_reg(6, (dev_base | 0x40) | ((target >> 24) & 0x0F));
-        }
-    } else {
-        uint16_t cyl = (uint16_t)target;
-        ide_write_reg(2, 1);
-        ide_write_reg(3, 1);                                   // sector 1 (1-based)
-        ide_write_reg(4, cyl & 0xFF);
-        ide_write_reg(5, (cyl >> 8) & 0xFF);
-        ide_write_reg(6, dev_base);                            // head 0, CHS
-    }
-    ide_write_reg(7, use_lba48 ? 0x24 : 0x20);                // READ SECTORS EXT / READ SECTORS
+    ide_cmd_t c;
+    ide_cmd_begin(&c);
+    bool use_lba48 = false;
+    if (lba) use_lba48 = cmd_lba(&c, target, 1);
+    else     cmd_chs(&c, (uint16_t)target, 0, 1, 1);           // head 0, sector 1
+    ide_cmd_issue(&c, use_lba48 ? 0x24 : 0x20);               // READ SECTORS EXT / READ SECTORS
 
     // Wait for BSY to clear
-    for (uint32_t t = 0; t < 10000; t++) {
-        if (config.intrq_enabled && gpio_get(IDE_INTRQ)) ide_read_reg(7);  // clear INTRQ
-        if (!(ide_read_reg(7) & 0x80)) break;
-        busy_wait_us_32(10);
-    }
+    wait_timed(IDE_TO_SEEK, false, false);
 
     // Drain DRQ data if present
     if (ide_read_reg(7) & 0x08) ide_drain_sector();
@@ -3,12 +3,51 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include "pico/platform.h"
+#include "hardware/timer.h"
+
+// Sector data path (register I/O, bursts, IRQ handlers, MSC callbacks) runs
+// from SRAM so XIP cache misses can't stall bus-timed code.  Configure with
+// -DATABOY_HOT_IN_FLASH=ON to leave it in flash for comparison (Debug X).
+// The build checks that it calls nothing in flash (check_hot.cmake).
+#ifndef ATABOY_HOT_IN_FLASH
+#define ATABOY_HOT_IN_FLASH 0
+#endif
+#if ATABOY_HOT_IN_FLASH
+#define IDE_HOT(f)      f
+#else
+#define IDE_HOT(f)      __not_in_flash_func(f)
+#endif
+
+// Deadlines on that path come from the raw timer register: time_us_64(),
+// absolute_time_t arithmetic and best_effort_wfe_or_timeout() are flash
+// code.  Good for spans up to 35 minutes.
+static __force_inline uint32_t ide_deadline_us(uint32_t us) { return time_us_32() + us; }
+static __force_inline bool ide_deadline_reached(uint32_t end) {
+    return (int32_t)(time_us_32() - end) >= 0;
+}
+static __force_inline uint32_t ide_deadline_left_us(uint32_t end) {
+    int32_t left = (int32_t)(end - time_us_32());
+    return left > 0 ? (uint32_t)left : 0;
+}
+// busy_wait_us_32() for that path: at least 'us' whole microseconds
+static __force_inline void ide_delay_us(uint32_t us) {
+    uint32_t t0 = time_us_32();
+    while (time_us_32() - t0 <= us)
+        tight_loop_contents();
+}
+
+// memmove() and memset() for that path; the C library's run from flash.
+// Byte loops, for the rare partial-sector and bookkeeping copies only.
+void    ide_memmove(void *dst, const void *src, uint32_t n);
+void    ide_memset(void *dst, uint8_t val, uint32_t n);
 
 // --- Pin Definitions ---
 // Data bus: GPIO 0-15   (PIO-managed)
+// DIR/OE, A0-A2, CS0/CS1: GPIO 16-22, 24-25 (PIO-managed, ide_reg SM)
 // DIOR:     GPIO 26     (PIO-managed)
 // DIOW:     GPIO 27     (PIO-managed)
-// All others: SIO-managed from C
+// RESET:    GPIO 23     (SIO-managed from C)
 
 #define IDE_DIR         16
 #define IDE_DIR1        17
@@ -20,8 +59,8 @@
 #define IDE_RESET       23
 #define IDE_CS0         24
 #define IDE_CS1         25
-#define IDE_DIOR        26      // PIO side-set (read SM)
-#define IDE_DIOW        27      // PIO side-set (write SM)
+#define IDE_DIOR        26      // PIO side-set (read + reg SMs)
+#define IDE_DIOW        27      // PIO side-set (write + reg SMs)
 #define IDE_IORDY       29      // 74LVC2G125 Buffer 1 output (1Y) → GPIO 29
 #define IDE_INTRQ       28      // 74LVC2G125 Buffer 2 output (2Y) → GPIO 28
 
@@ -29,10 +68,15 @@
 #define ADDR_MASK       ((1 << IDE_A0) | (1 << IDE_A1) | (1 << IDE_A2))
 
 // --- IDE Interface ---
-void    ide_select_device(uint8_t base);   // 0xA0 = master, 0xB0 = slave
-uint8_t ide_probe_devices(void);           // reset + scan master/slave, return dev_base or 0
+// 0xA0 = master, 0xB0 = slave.  Each device keeps its own transfer mode,
+// multiple block, cache settings, learnt timeouts, bad-sector map and
+// geometry (config.lun[]); selecting one swaps them in.
+void    ide_select_device(uint8_t base);
+uint8_t ide_get_device(void);
+uint8_t ide_probe_devices(void);           // reset + discover both devices, return dev_base or 0
 void    ide_hw_init(void);
-void    ide_reset_drive(void);
+bool    ide_reset_drive(void);           // false if the drive never came ready
+void    ide_soft_reset(void);           // SRST + restore geometry/transfer mode
 bool    ide_wait_until_ready(uint32_t timeout_ms);
 
 void    ide_write_reg(uint8_t reg, uint8_t val);
@@ -41,12 +85,169 @@ uint8_t ide_read_alt_status(void);
 void    ide_write_control(uint8_t val);
 void    ide_set_iordy(bool enabled);
 
+// IORDY flow control and INTRQ completion for the selected drive; kept
+// per device like the transfer mode.  ide_set_iordy() alone only
+// switches the pin for a reset.
+void    ide_set_handshake(bool iordy, bool intrq);
+bool    ide_get_iordy(void);
+bool    ide_get_intrq(void);
+
+// --- Bus arbiter ---
+// USB and the menus run on different cores.  While drives are mounted,
+// whoever issues commands holds the lock from selecting the device until
+// the last command has finished.
+void    ide_bus_lock(void);
+void    ide_bus_unlock(void);
+
+// --- Discovery ---
+// ide_probe_devices() runs EXECUTE DEVICE DIAGNOSTIC once for both devices
+// and IDENTIFYs each one found.  The result stays cached for the menus and
+// auto-mount until the next probe.
+#define IDE_DEV_MASTER  0x01
+#define IDE_DEV_SLAVE   0x02
+
+typedef struct {
+    bool     probed;
+    uint8_t  present;           // IDE_DEV_* (ATA devices only)
+    bool     diag_ok;           // diagnostic completed; code in 'diag'
+    uint8_t  diag;              // 01h all passed, 81h device 1 failed, else device 0 failed
+    bool     id_valid[2];
+    uint16_t id[2][256];        // [0] master, [1] slave
+} ide_bus_t;
+
+const ide_bus_t *ide_get_bus(void);
+const uint16_t  *ide_cached_identify(uint8_t base);    // NULL if none
+uint8_t          ide_discovered_base(void);             // preferred device, or 0
+
+// --- Command images ---
+// The taskfile writes for one command are collected here and played onto
+// the bus in a single DMA burst that ends with the Command register write.
+// Writes that would not change a register are dropped at issue time.
+#define IDE_CMD_MAX     12
+
+typedef struct {
+    uint8_t  reg[IDE_CMD_MAX];
+    uint8_t  val[IDE_CMD_MAX];
+    uint8_t  n;
+    uint8_t  keep, keep_hob;                // address regs a sector command can't change
+} ide_cmd_t;
+
+void    ide_cmd_begin(ide_cmd_t *c);
+void    ide_cmd_reg(ide_cmd_t *c, uint8_t reg, uint8_t val);
+void    ide_cmd_issue(ide_cmd_t *c, uint8_t command);    // appends reg 7, plays image
+
+// Taskfile writes ide_cmd_issue() skipped because the register already
+// held the value (shadow taskfile).  Cleared only at power-up.
+uint32_t ide_get_elided(void);
+
 bool    ide_identify(uint16_t *buf);
 bool    ide_set_geometry(uint8_t heads, uint8_t spt);
+bool    ide_set_features(uint8_t feature, uint8_t count);   // false on ABRT/timeout
 void    ide_drain_sector(void);
 
-int32_t ide_read_sectors(uint32_t lba, uint32_t count, uint8_t *buf);
-int32_t ide_write_sectors(uint32_t lba, uint32_t count, const uint8_t *buf);
+// Fastest PIO mode (0-4) the drive advertises in its IDENTIFY data, limited
+// by the word 67/68 minimum cycle time with or without IORDY.  Modes 3-4
+// only with IORDY.
+uint8_t ide_best_pio_mode(const uint16_t *id, bool iordy);
+// Program the drive with SET FEATURES and switch the bus timing to match.
+// Returns the mode actually in use.
+// Applies the Auto Tune Bus result stored for this position (mode cap,
+// margin, IORDY, INTRQ) when the drive matches, else the Features
+// IORDY/INTRQ settings.
+uint8_t ide_negotiate_pio_mode(const uint16_t *id);
+// SET MULTIPLE MODE (0xC6) with the largest power-of-two block within
+// IDENTIFY word 47, halving on ABRT.  Sector I/O then uses READ/WRITE
+// MULTIPLE; returns sectors per block, 0 when the drive stays on
+// single-sector commands.  Cleared by hardware reset, restored after SRST.
+uint8_t ide_negotiate_multiple(const uint16_t *id);
+bool    ide_set_multiple(uint8_t count);         // false on ABRT/timeout
+uint8_t ide_get_multiple(void);
+// SET FEATURES 02h/82h: turn the drive's write cache on or off, if IDENTIFY
+// word 82 says it has one.  Returns whether it now caches writes.  Cleared
+// by hardware reset, restored after SRST.
+bool    ide_set_write_cache(const uint16_t *id, bool enable);
+bool    ide_get_write_cache(void);
+// FLUSH CACHE (EXT): commit cached writes to the media.  true when there
+// is nothing cached or the drive reports the flush done.
+bool    ide_flush_cache(void);
+// SET FEATURES AAh/55h: drive read look-ahead on or off.  false if the
+// drive refuses it.  Cleared by hardware reset, restored after SRST.
+bool    ide_set_lookahead(bool enable);
+bool    ide_get_lookahead(void);        // true only if we turned it on
+// Short hash of IDENTIFY serial + model, used to key per-drive settings.
+uint16_t ide_identify_tag(const uint16_t *id);
+
+// WRITE BUFFER then READ BUFFER of one 256-word block (no media access).
+// Returns the number of mismatched words, or -1 if either command failed.
+// *intrq_seen reports whether INTRQ was up when READ BUFFER raised DRQ.
+int32_t ide_buffer_loopback(const uint16_t *out, uint16_t *in, bool *intrq_seen);
+
+// 48-bit LBA, any count: split into commands of up to 256 sectors
+// (CHS/LBA28) or 65536 (LBA48), whole multiple blocks, and CHS tracks if
+// config.chs_track_split.  Each command uses LBA28 when it fits.
+// Returns count * 512, or -1 if any command failed.
+//
+// A read that hits an error keeps the sectors already transferred,
+// bisects the failing block down to the unreadable sectors (zero-filled
+// in buf) and re-issues the rest of the request; a drive that reports a
+// media error is not reset.  -1 is still returned if any sector failed,
+// with the details in ide_get_xfer_error().  Sectors the drive reports
+// unreadable (IDE_ERR_UNREADABLE) go into the bad-sector map (badmap.h); a
+// later read that reaches a mapped sector stops there without touching it
+// unless config.retry_known_bad is set.
+int32_t ide_read_sectors(uint64_t lba, uint32_t count, uint8_t *buf);
+int32_t ide_write_sectors(uint64_t lba, uint32_t count, const uint8_t *buf);
+
+// For diagnostics and tuning: the same split into commands, but no bad-sector
+// map, no isolation and no ide_get_xfer_error() record.  -1 on any failure.
+int32_t ide_read_sectors_raw(uint64_t lba, uint32_t count, uint8_t *buf);
+
+// Error register bits that say the sector itself is bad (BBK, UNC), as
+// opposed to an address or timing fault (IDNF, AMNF, ABRT)
+#define IDE_ERR_UNREADABLE  0xC0
+
+// Outcome of the last ide_read_sectors() or ide_write_sectors().  For a
+// write, the failing block is known but not the sector within it.
+typedef struct {
+    uint32_t good;          // sectors before the first failure, all valid
+    uint32_t bad;           // sectors found unreadable
+    uint64_t first_bad;     // LBA of the first failure (valid if good < count)
+    uint8_t  error;         // its Error register (reads), 0 = timed out or mapped
+    bool     complete;      // every other sector was read
+    bool     mapped;        // first_bad is in the bad-sector map, not read
+} ide_xfer_err_t;
+
+void    ide_get_xfer_error(ide_xfer_err_t *out);
+
+// READ VERIFY SECTORS (EXT): the drive reads and checks 'count' (1-256)
+// sectors without transferring them.  0 = clean; -1 = media error at *bad,
+// its Error register in *err, drive idle; -2 = timeout or other failure,
+// drive soft-reset.
+int     ide_verify_sectors(uint64_t lba, uint32_t count, uint64_t *bad, uint8_t *err);
+
+// Completions that came through the Alt Status fallback instead of INTRQ
+// while INTRQ was enabled.
+uint32_t ide_get_intrq_missed(void);
+
+// --- Command timeouts ---
+// Each wait on the drive has a wall-clock budget by class.  Spin-up (reset,
+// probe) is fixed.  The others start at config.fail_ceiling_ms and, once
+// the drive has completed enough commands of that class, shrink to a
+// multiple of its observed p99 — never above the ceiling, so a hung sector
+// is reported long before the USB host times out and resets the bus.
+// Learnt per device; dropped when the devices are probed.
+typedef enum {
+    IDE_TO_SPINUP,
+    IDE_TO_SEEK,            // non-data commands, IDENTIFY, seek test
+    IDE_TO_READ,            // per DRQ block
+    IDE_TO_WRITE,           // per DRQ block and final commit
+    IDE_TO_CLASSES
+} ide_to_t;
+
+uint32_t ide_timeout_ms(ide_to_t cls);
+uint32_t ide_timeout_p99_us(ide_to_t cls);      // 0 until enough samples
+uint32_t ide_timeout_expired(ide_to_t cls);     // waits that ran out
+void     ide_timeout_reset(void);
 
 // Read task file registers 1-7 into tf[1]..tf[7] (tf[0] unused).
 void    ide_read_taskfile(uint8_t tf[8]);
@@ -2,69 +2,589 @@
 #include "ide.h"
 #include "ataboy.pio.h"
 #include "hardware/pio.h"
+#include "hardware/dma.h"
+#include "hardware/irq.h"
+#include "hardware/sync.h"
 #include "hardware/clocks.h"
 #include "hardware/gpio.h"
+#include "hardware/structs/systick.h"
+#include "hardware/timer.h"
 #include "pico/stdlib.h"
 
 static PIO pio = pio0;
 static uint sm_read;
 static uint sm_write;
+static uint sm_reg;
 static uint offset_read;
 static uint offset_write;
+static uint offset_reg;
+static bool sms_ready = false;
 
+// DMA read path — one channel paced by the read SM's RX DREQ
+static int  dma_read_chan;
+static bool dma_enabled = true;
+static volatile bool read_done = false;
+
+// DMA write path — count channel chains into payload channel, both paced
+// by the write SM's TX DREQ
+static int  dma_wcount_chan;
+static int  dma_write_chan;
+static uint32_t write_count_word;
+static volatile bool write_done = false;
+
+// Command image path — 32-bit register words -> ide_reg TX FIFO
+static int  dma_reg_chan;
+
+// Status poller — armed while ide_reg strobes Status waiting for BSY=0
+static volatile bool poll_armed = false;
+
+// Read chain — control channel reloads the worker from chain[] (alias 3
+// layout: ctrl, write addr, count, read addr + trigger), one block per step
+#define CHAIN_STEPS     7
+
+typedef struct {
+    uint32_t ctrl;
+    volatile void *write_addr;
+    uint32_t count;
+    const volatile void *read_addr;
+} chain_block_t;
+
+static int  dma_ctl_chan;
+static int  dma_work_chan;
+static int  chain_timer;
+static uint16_t chain_ticks = 0xFFFF;       // settle step, per ide_pio_set_mode()
+static uint32_t ctrl_reg_tx, ctrl_reg_rx, ctrl_delay, ctrl_ack, ctrl_count, ctrl_data;
+static chain_block_t chain[IDE_PIO_CHAIN_MAX * CHAIN_STEPS + 1] __attribute__((aligned(16)));
+static uint32_t chain_words[2];             // poll Status, then select the data register
+static uint32_t chain_status[IDE_PIO_CHAIN_MAX];
+static uint32_t chain_count_word;
+static uint32_t chain_ack_word;
+static uint32_t chain_dummy[2];
+static uint32_t chain_blocks;
+static volatile bool chain_done = false;
+
+static ide_pio_stats_t stats;
+
+// ide_reg FIFO word: bit 0 = write direction, bits 1-26 = levels for
+// GPIO 0-25, bits 27-31 = PC to dispatch to (see ataboy.pio)
+#define REG_WRITE       (1u << 0)
+#define REG_PIN(g)      (1u << ((g) + 1))
+#define REG_PC_SHIFT    27
+
+// ---------------------------------------------------------------------------
+//  ATA PIO timing (ns): t0 cycle, t2 strobe, t2i recovery, t3 write setup
+// ---------------------------------------------------------------------------
+
+typedef struct { uint16_t t0, t2, t2i, t3; } pio_timing_t;
+
+// 16-bit data register cycles
+static const pio_timing_t timing_data[5] = {
+    {600, 165,  0, 60}, {383, 125,  0, 45}, {240, 100,  0, 30},
+    {180,  80, 70, 30}, {120,  70, 25, 20},
+};
+
+// 8-bit register cycles — modes 0-2 keep the long Mode 0 strobe.  ide_reg
+// has the same 4-cycle strobe but a longer setup and recovery, so the data
+// loop shape below bounds it too.
+static const pio_timing_t timing_reg[5] = {
+    {600, 290,  0, 60}, {383, 290,  0, 45}, {330, 290,  0, 30},
+    {180,  80, 70, 30}, {120,  70, 25, 20},
+};
+
+// Loop shape in PIO cycles — must match ataboy.pio
+#define CYC_SETUP   1
+#define CYC_LOW     4
+#define CYC_HIGH    3
+#define CYC_TOTAL   7
+
+static uint8_t  pio_mode = 0;
+static uint8_t  pio_margin = 0;             // % added to every timing minimum
+static uint32_t div_data, div_reg;          // 24.8 fixed-point PIO dividers
+
+// ---------------------------------------------------------------------------
+//  CPU cycle accounting — SysTick as a free-running 24-bit down-counter
+// ---------------------------------------------------------------------------
+
+static __force_inline uint32_t cycles_now(void) {
+    return systick_hw->cvr;
+}
+
+static __force_inline uint32_t cycles_since(uint32_t start) {
+    return (start - systick_hw->cvr) & 0x00FFFFFF;
+}
+
+// SysTick is banked per core, so each core that runs bursts starts its own
+void ide_pio_core_init(void) {
+    systick_hw->rvr = 0x00FFFFFF;
+    systick_hw->cvr = 0;
+    systick_hw->csr = 0x5;                  // CLKSOURCE = processor, ENABLE
+}
+
+// ---------------------------------------------------------------------------
+//  Divider calculation
+// ---------------------------------------------------------------------------
+
+// Smallest 24.8 divider for which 'cycles' PIO clocks last at least 'ns'.
+// A fractional divider may run a span short by up to one clk_sys period,
+// so the bound is taken on whole clk_sys periods.
+static uint32_t span_div(uint32_t ns, uint32_t cycles, uint32_t hz) {
+    uint32_t sys = (uint32_t)(((uint64_t)ns * hz + 999999999u) / 1000000000u);
+    return (sys * 256 + cycles - 1) / cycles;
+}
+
+static uint32_t timing_div(const pio_timing_t *t, uint32_t hz) {
+    uint32_t d = 256;                               // 1.0 minimum
+    uint32_t v, m = 100 + pio_margin;
+    if ((v = span_div(t->t0  * m / 100, CYC_TOTAL, hz)) > d) d = v;
+    if ((v = span_div(t->t2  * m / 100, CYC_LOW,   hz)) > d) d = v;
+    if ((v = span_div(t->t2i * m / 100, CYC_HIGH,  hz)) > d) d = v;
+    if ((v = span_div(t->t3  * m / 100, CYC_SETUP, hz)) > d) d = v;
+    if (d > (0xFFFFu << 8)) d = 0xFFFFu << 8;
+    return d;
+}
+
+static __force_inline void apply_dividers(void) {
+    if (!sms_ready) return;
+    // All SMs sit stalled on 'pull' between accesses, safe to retime
+    pio_sm_set_clkdiv_int_frac8(pio, sm_read,  div_data >> 8, div_data & 0xFF);
+    pio_sm_set_clkdiv_int_frac8(pio, sm_write, div_data >> 8, div_data & 0xFF);
+    pio_sm_set_clkdiv_int_frac8(pio, sm_reg,   div_reg >> 8,  div_reg & 0xFF);
+}
+
+void ide_pio_set_mode(uint8_t mode) {
+    if (mode > 4) mode = 4;
+    uint32_t hz = clock_get_hz(clk_sys);
+    pio_mode = mode;
+    div_data = timing_div(&timing_data[mode], hz);
+    div_reg  = timing_div(&timing_reg[mode], hz);
+
+    // Read chain delay steps: two timer ticks, each at least two register
+    // cycles and 200 ns.  Before a Status poll that covers the 400 ns the
+    // drive has to raise BSY after the command or the last burst; before a
+    // burst, ide_reg has finished the select and DIOR recovery is met
+    uint32_t tick_ns = 2 * ide_pio_cycle_ns(false);
+    if (tick_ns < 200) tick_ns = 200;
+    uint64_t ticks = (uint64_t)hz * tick_ns / 1000000000u + 1;
+    chain_ticks = ticks > 0xFFFF ? 0xFFFF : (uint16_t)ticks;
+    apply_dividers();
+}
+
+uint8_t ide_pio_get_mode(void) { return pio_mode; }
+
+void IDE_HOT(ide_pio_get_timing)(ide_pio_timing_t *t) {
+    *t = (ide_pio_timing_t){ .div_data = div_data, .div_reg = div_reg, .chain_ticks = chain_ticks,
+                             .mode = pio_mode, .margin = pio_margin };
+}
+
+void IDE_HOT(ide_pio_set_timing)(const ide_pio_timing_t *t) {
+    pio_mode = t->mode;
+    pio_margin = t->margin;
+    if (!t->div_data) {                     // never computed
+        ide_pio_set_mode(t->mode);
+        return;
+    }
+    if (t->div_data == div_data && t->div_reg == div_reg) return;
+    div_data = t->div_data;
+    div_reg = t->div_reg;
+    chain_ticks = t->chain_ticks;
+    apply_dividers();
+}
+
+void ide_pio_set_margin(uint8_t pct) {
+    pio_margin = pct;
+    ide_pio_set_mode(pio_mode);
+}
+
+uint8_t ide_pio_get_margin(void) { return pio_margin; }
+
+uint32_t ide_pio_cycle_ns(bool data) {
+    uint64_t d = data ? div_data : div_reg;
+    return (uint32_t)((d * CYC_TOTAL * 1000000000ull) / ((uint64_t)clock_get_hz(clk_sys) << 8));
+}
+
+// ---------------------------------------------------------------------------
+//  Completion IRQ — 'irq wait 0 rel' at the end of a DMA burst, or the
+//  status poller's result landing in the ide_reg RX FIFO
+// ---------------------------------------------------------------------------
+
+static void IDE_HOT(ide_pio_irq_handler)(void) {
+    if (pio->irq & (1u << sm_read)) {
+        pio_set_irq0_source_enabled(pio, pis_interrupt0 + sm_read, false);
+        pio->irq = 1u << sm_read;           // release the SM
+        read_done = true;
+    }
+    if (pio->irq & (1u << sm_write)) {
+        pio_set_irq0_source_enabled(pio, pis_interrupt0 + sm_write, false);
+        pio->irq = 1u << sm_write;
+        write_done = true;
+    }
+    if (poll_armed && !pio_sm_is_rx_fifo_empty(pio, sm_reg)) {
+        pio_set_irq0_source_enabled(pio, pis_sm0_rx_fifo_not_empty + sm_reg, false);
+        poll_armed = false;
+    }
+    __sev();                                // wake whichever core is in WFE
+}
+
+static void IDE_HOT(chain_irq_handler)(void) {
+    if (dma_channel_get_irq0_status(dma_work_chan)) {
+        dma_channel_acknowledge_irq0(dma_work_chan);
+        chain_done = true;
+    }
+    __sev();
+}
+
+// ---------------------------------------------------------------------------
+//  Timed sleep — WFE with a raw timer alarm as the timeout wake-up
+// ---------------------------------------------------------------------------
+// best_effort_wfe_or_timeout() runs from flash through the alarm pool.
+// Each core gets its own alarm; the IRQ only raises an event, so every
+// waiter rechecks its own condition and deadline after waking.
+
+static uint wake_alarm[2];                  // per core
+static uint32_t wake_mask;
+
+static void IDE_HOT(wake_irq_handler)(void) {
+    timer_hw->intr = wake_mask;
+    __sev();
+}
+
+void IDE_HOT(ide_pio_sleep_until)(uint32_t end) {
+    timer_hw->alarm[wake_alarm[get_core_num()]] = end;     // arms it
+    // Already due: the alarm would not match again until the timer wraps
+    if (!ide_deadline_reached(end))
+        __wfe();
+}
+
+// Worker CTRL value for one chain step; every step chains back to the
+// control channel and stays quiet until the null block
+static uint32_t chain_ctrl(enum dma_channel_transfer_size size, bool rd_inc, bool wr_inc, uint dreq) {
+    dma_channel_config c = dma_channel_get_default_config(dma_work_chan);
+    channel_config_set_transfer_data_size(&c, size);
+    channel_config_set_read_increment(&c, rd_inc);
+    channel_config_set_write_increment(&c, wr_inc);
+    channel_config_set_dreq(&c, dreq);
+    channel_config_set_chain_to(&c, dma_ctl_chan);
+    channel_config_set_irq_quiet(&c, true);
+    return channel_config_get_ctrl_value(&c);
+}
 
 void ide_pio_init(void) {
-    // Load both programs into PIO instruction memory (17 of 32 slots)
+    ide_pio_set_mode(0);
+
+    // Load all three programs into PIO instruction memory (32 of 32 slots)
     offset_read  = pio_add_program(pio, &ide_read_program);
     offset_write = pio_add_program(pio, &ide_write_program);
+    offset_reg   = pio_add_program(pio, &ide_reg_program);
 
     sm_read  = pio_claim_unused_sm(pio, true);
     sm_write = pio_claim_unused_sm(pio, true);
+    sm_reg   = pio_claim_unused_sm(pio, true);
 
-    // Hand GPIO 0-15 (data bus), 26 (DIOR), 27 (DIOW) to PIO
-    for (int i = 0; i < 16; i++) pio_gpio_init(pio, i);
-    pio_gpio_init(pio, 26);
-    pio_gpio_init(pio, 27);
+    // Hand GPIO 0-22 and 24-27 to PIO — RESET (23) stays on SIO
+    for (int i = 0; i < 28; i++)
+        if (i != IDE_RESET) pio_gpio_init(pio, i);
 
     // ---- Read SM (DIOR strobe) ----
     pio_sm_config c_rd = ide_read_program_get_default_config(offset_read);
     sm_config_set_in_pins(&c_rd, 0);                       // in base = GPIO 0
-    sm_config_set_sideset_pins(&c_rd, 26);                  // side-set = DIOR
-    sm_config_set_in_shift(&c_rd, false, true, 16);         // shift left, autopush @ 16
-    sm_config_set_clkdiv(&c_rd, 15.0f);                    // 150 MHz / 15 = 10 MHz
-
+    sm_config_set_sideset_pins(&c_rd, IDE_DIOR);            // side-set = DIOR
+    sm_config_set_in_shift(&c_rd, true, true, 32);          // shift right, two words per push
+    sm_config_set_out_shift(&c_rd, true, true, 16);         // count word, autopull @ 16
+    sm_config_set_clkdiv_int_frac8(&c_rd, div_data >> 8, div_data & 0xFF);
     pio_sm_init(pio, sm_read, offset_read, &c_rd);
 
-    // Set DIOR HIGH and output before enabling SM (avoids LOW glitch)
-    pio_sm_set_pins_with_mask(pio, sm_read, 1u << 26, 1u << 26);
-    pio_sm_set_consecutive_pindirs(pio, sm_read, 26, 1, true);
-
     // ---- Write SM (DIOW strobe) ----
     pio_sm_config c_wr = ide_write_program_get_default_config(offset_write);
     sm_config_set_out_pins(&c_wr, 0, 16);                  // out base = GPIO 0, 16 pins
-    sm_config_set_sideset_pins(&c_wr, 27);                  // side-set = DIOW
-    sm_config_set_out_shift(&c_wr, true, false, 32);        // shift right, manual pull
-    sm_config_set_clkdiv(&c_wr, 15.0f);
-
+    sm_config_set_sideset_pins(&c_wr, IDE_DIOW);            // side-set = DIOW
+    sm_config_set_out_shift(&c_wr, true, true, 32);         // shift right, two words per pull
+    sm_config_set_clkdiv_int_frac8(&c_wr, div_data >> 8, div_data & 0xFF);
     pio_sm_init(pio, sm_write, offset_write, &c_wr);
 
-    // Set DIOW HIGH and output; data bus starts as input
-    pio_sm_set_pins_with_mask(pio, sm_write, 1u << 27, 1u << 27);
-    pio_sm_set_consecutive_pindirs(pio, sm_write, 27, 1, true);
-    pio_sm_set_consecutive_pindirs(pio, sm_write, 0, 16, false);
+    // ---- Register SM (address, CS, transceivers, DIOR/DIOW) ----
+    pio_sm_config c_rg = ide_reg_program_get_default_config(offset_reg);
+    sm_config_set_out_pins(&c_rg, 0, 26);                  // GPIO 0-25
+    sm_config_set_set_pins(&c_rg, IDE_DIR, 4);              // DIR, DIR1, OE, OE1
+    sm_config_set_sideset_pins(&c_rg, IDE_DIOR);            // DIOR, DIOW
+    sm_config_set_in_pins(&c_rg, 0);
+    sm_config_set_jmp_pin(&c_rg, 7);                        // status BSY for the poller
+    sm_config_set_out_shift(&c_rg, true, false, 32);        // shift right, manual pull
+    sm_config_set_in_shift(&c_rg, false, true, 16);         // shift left, autopush @ 16
+    sm_config_set_clkdiv_int_frac8(&c_rg, div_reg >> 8, div_reg & 0xFF);
+    pio_sm_init(pio, sm_reg, offset_reg, &c_rg);
 
-    // Start both SMs (they immediately stall on pull block)
+    // Idle levels before any pin becomes an output (avoids strobe glitches):
+    // DIR = read, OE disabled, A = 0, CS0/CS1/DIOR/DIOW HIGH
+    uint32_t ctl = ((1u << 12) - 1) << IDE_DIR;           // GPIO 16-27
+    ctl &= ~(1u << IDE_RESET);
+    uint32_t idle = (1u << IDE_OE) | (1u << IDE_OE1) |
+                    (1u << IDE_CS0) | (1u << IDE_CS1) |
+                    (1u << IDE_DIOR) | (1u << IDE_DIOW);
+    pio_sm_set_pins_with_mask(pio, sm_reg, idle, ctl);
+    pio_sm_set_pindirs_with_mask(pio, sm_reg, ctl, ctl | DATA_MASK);   // data bus in
+
+    // ide_reg's mov pindirs covers GPIO 0-25; keep 16-25 driven regardless
+    for (int i = IDE_DIR; i <= IDE_CS1; i++)
+        if (i != IDE_RESET) gpio_set_oeover(i, GPIO_OVERRIDE_HIGH);
+
+    // Y = 0: transceivers face the drive (side-set kept idle)
+    pio_sm_exec(pio, sm_reg, pio_encode_set(pio_y, 0) | pio_encode_sideset(2, 3));
+
+    // ---- Read DMA: RX FIFO -> buffer, 32-bit beats (word pairs), RX DREQ ----
+    dma_read_chan = dma_claim_unused_channel(true);
+    dma_channel_config dc = dma_channel_get_default_config(dma_read_chan);
+    channel_config_set_transfer_data_size(&dc, DMA_SIZE_32);
+    channel_config_set_read_increment(&dc, false);
+    channel_config_set_write_increment(&dc, true);
+    channel_config_set_dreq(&dc, pio_get_dreq(pio, sm_read, false));
+    dma_channel_configure(dma_read_chan, &dc, NULL, &pio->rxf[sm_read], 0, false);
+
+    // ---- Write DMA: count word, then payload (word pairs) -> TX FIFO ----
+    dma_wcount_chan = dma_claim_unused_channel(true);
+    dma_write_chan  = dma_claim_unused_channel(true);
+
+    dma_channel_config wc = dma_channel_get_default_config(dma_write_chan);
+    channel_config_set_transfer_data_size(&wc, DMA_SIZE_32);
+    channel_config_set_read_increment(&wc, true);
+    channel_config_set_write_increment(&wc, false);
+    channel_config_set_dreq(&wc, pio_get_dreq(pio, sm_write, true));
+    dma_channel_configure(dma_write_chan, &wc, &pio->txf[sm_write], NULL, 0, false);
+
+    dma_channel_config cc = dma_channel_get_default_config(dma_wcount_chan);
+    channel_config_set_transfer_data_size(&cc, DMA_SIZE_32);
+    channel_config_set_read_increment(&cc, false);
+    channel_config_set_write_increment(&cc, false);
+    channel_config_set_dreq(&cc, pio_get_dreq(pio, sm_write, true));
+    channel_config_set_chain_to(&cc, dma_write_chan);
+    dma_channel_configure(dma_wcount_chan, &cc, &pio->txf[sm_write], &write_count_word, 1, false);
+
+    // ---- Register DMA: command image words -> ide_reg TX FIFO ----
+    dma_reg_chan = dma_claim_unused_channel(true);
+    dma_channel_config rc = dma_channel_get_default_config(dma_reg_chan);
+    channel_config_set_transfer_data_size(&rc, DMA_SIZE_32);
+    channel_config_set_read_increment(&rc, true);
+    channel_config_set_write_increment(&rc, false);
+    channel_config_set_dreq(&rc, pio_get_dreq(pio, sm_reg, true));
+    dma_channel_configure(dma_reg_chan, &rc, &pio->txf[sm_reg], NULL, 0, false);
+
+    // ---- Read chain: control channel -> worker alias 3 (16-byte ring) ----
+    dma_ctl_chan  = dma_claim_unused_channel(true);
+    dma_work_chan = dma_claim_unused_channel(true);
+    chain_timer   = dma_claim_unused_timer(true);
+    chain_ack_word = 1u << sm_read;
+
+    dma_channel_config kc = dma_channel_get_default_config(dma_ctl_chan);
+    channel_config_set_transfer_data_size(&kc, DMA_SIZE_32);
+    channel_config_set_read_increment(&kc, true);
+    channel_config_set_write_increment(&kc, true);
+    channel_config_set_ring(&kc, true, 4);
+    dma_channel_configure(dma_ctl_chan, &kc, &dma_hw->ch[dma_work_chan].al3_ctrl, chain, 4, false);
+
+    ctrl_reg_tx = chain_ctrl(DMA_SIZE_32, true,  false, pio_get_dreq(pio, sm_reg, true));
+    ctrl_reg_rx = chain_ctrl(DMA_SIZE_32, false, false, pio_get_dreq(pio, sm_reg, false));
+    ctrl_delay  = chain_ctrl(DMA_SIZE_32, false, false, dma_get_timer_dreq(chain_timer));
+    ctrl_ack    = chain_ctrl(DMA_SIZE_32, false, false, DREQ_FORCE);
+    ctrl_count  = chain_ctrl(DMA_SIZE_32, false, false, pio_get_dreq(pio, sm_read, true));
+    ctrl_data   = chain_ctrl(DMA_SIZE_32, false, true,  pio_get_dreq(pio, sm_read, false));
+
+    // The null block at the end of a chain raises DMA_IRQ_0 (IRQ_QUIET)
+    dma_channel_set_irq0_enabled(dma_work_chan, true);
+    irq_set_exclusive_handler(DMA_IRQ_0, chain_irq_handler);
+    irq_set_enabled(DMA_IRQ_0, true);
+
+    // Completion IRQ — source is enabled per burst, only while DMA owns the SM
+    irq_set_exclusive_handler(PIO0_IRQ_0, ide_pio_irq_handler);
+    irq_set_enabled(PIO0_IRQ_0, true);
+
+    // Timeout wake-up for ide_pio_sleep_until(), one alarm per core; both
+    // IRQs land here and the SEV reaches the other core too
+    for (int c = 0; c < 2; c++) {
+        wake_alarm[c] = (uint)hardware_alarm_claim_unused(true);
+        wake_mask |= 1u << wake_alarm[c];
+        irq_set_exclusive_handler(hardware_alarm_get_irq_num(wake_alarm[c]), wake_irq_handler);
+        irq_set_enabled(hardware_alarm_get_irq_num(wake_alarm[c]), true);
+    }
+    hw_set_bits(&timer_hw->inte, wake_mask);
+
+    ide_pio_core_init();
+
+    // Start all SMs (they immediately stall on pull block)
     pio_sm_set_enabled(pio, sm_read, true);
     pio_sm_set_enabled(pio, sm_write, true);
+    pio_sm_set_enabled(pio, sm_reg, true);
+    sms_ready = true;
+}
+
+// ---------------------------------------------------------------------------
+//  Register access — one FIFO word per access through ide_reg
+// ---------------------------------------------------------------------------
+
+// Direction ide_reg's Y holds as far as C knows; false whenever unsure
+static bool reg_facing_write = false;
+
+// Read -> write: ide_reg's turn only drops OE, leaving DIR facing the
+// drive.  This word swings DIR with OE still off and no CS selected, so
+// DIR has settled by the time the real write word enables OE.
+static __force_inline void face_write(void) {
+    if (reg_facing_write) return;
+    reg_facing_write = true;
+    pio_sm_put_blocking(pio, sm_reg, REG_WRITE | REG_PIN(IDE_DIR) | REG_PIN(IDE_DIR1) |
+                        REG_PIN(IDE_OE) | REG_PIN(IDE_OE1) | REG_PIN(IDE_RESET) |
+                        REG_PIN(IDE_CS0) | REG_PIN(IDE_CS1) |
+                        ((offset_reg + ide_reg_offset_top) << REG_PC_SHIFT));
+}
 
+static __force_inline void reg_put(uint32_t w) {
+    if (w & REG_WRITE) face_write();
+    else reg_facing_write = false;
+    pio_sm_put_blocking(pio, sm_reg, w);
 }
 
-void ide_pio_read(uint32_t count, uint16_t *buf) {
+static __force_inline uint32_t reg_word(bool write, bool cs1, uint8_t addr, uint16_t data, uint pc) {
+    uint32_t w = ((uint32_t)data << 1) |
+                 ((uint32_t)(addr & 0x07) << (IDE_A0 + 1)) |
+                 REG_PIN(IDE_RESET) |
+                 (cs1 ? REG_PIN(IDE_CS0) : REG_PIN(IDE_CS1));     // other CS HIGH
+    if (write) w |= REG_WRITE | REG_PIN(IDE_DIR) | REG_PIN(IDE_DIR1);
+    // OE/OE1 bits left at 0: transceivers enabled
+    return w | ((offset_reg + pc) << REG_PC_SHIFT);
+}
+
+uint32_t IDE_HOT(ide_pio_reg_word)(bool cs1, uint8_t addr, uint8_t val) {
+    return reg_word(true, cs1, addr, val, ide_reg_offset_strobe_w);
+}
+
+void IDE_HOT(ide_pio_reg_write)(bool cs1, uint8_t addr, uint8_t val) {
+    reg_put(ide_pio_reg_word(cs1, addr, val));
+}
+
+void IDE_HOT(ide_pio_reg_burst)(const uint32_t *words, uint32_t n) {
+    face_write();                           // images are register writes
+    dma_channel_transfer_from_buffer_now(dma_reg_chan, words, n);
+    dma_channel_wait_for_finish_blocking(dma_reg_chan);
+    ide_pio_reg_flush();
+}
+
+uint8_t IDE_HOT(ide_pio_reg_read)(bool cs1, uint8_t addr) {
+    reg_put(reg_word(false, cs1, addr, 0, ide_reg_offset_strobe_r));
+    return (uint8_t)(pio_sm_get_blocking(pio, sm_reg) & 0xFF);
+}
+
+void IDE_HOT(ide_pio_reg_flush)(void) {
+    // TXSTALL is sticky and re-asserts every cycle the SM waits on an empty
+    // FIFO, so once it sets after clearing, every queued word is on the bus
+    uint32_t stall = 1u << (PIO_FDEBUG_TXSTALL_LSB + sm_reg);
+    pio->fdebug = stall;
+    while (!(pio->fdebug & stall))
+        tight_loop_contents();
+}
+
+void ide_pio_bus_idle(void) {
+    // Read direction, OE disabled, both chip selects HIGH, no strobe
+    uint32_t w = REG_PIN(IDE_OE) | REG_PIN(IDE_OE1) | REG_PIN(IDE_RESET) |
+                 REG_PIN(IDE_CS0) | REG_PIN(IDE_CS1) |
+                 ((offset_reg + ide_reg_offset_top) << REG_PC_SHIFT);
+    reg_put(w);
+    ide_pio_reg_flush();
+}
+
+// ---------------------------------------------------------------------------
+//  Status poller — ide_reg strobes Status until BSY clears
+// ---------------------------------------------------------------------------
+
+void IDE_HOT(ide_pio_poll_start)(bool cs1) {
+    poll_armed = true;
+    pio_set_irq0_source_enabled(pio, pis_sm0_rx_fifo_not_empty + sm_reg, true);
+    reg_put(reg_word(false, cs1, cs1 ? 6 : 7, 0, ide_reg_offset_poll));
+}
+
+bool IDE_HOT(ide_pio_poll_busy)(void) {
+    return pio_sm_is_rx_fifo_empty(pio, sm_reg);
+}
+
+// Pull ide_reg out of the poll loop; DIOR released by the exec'd jump
+static void IDE_HOT(poll_stop)(void) {
+    pio_set_irq0_source_enabled(pio, pis_sm0_rx_fifo_not_empty + sm_reg, false);
+    poll_armed = false;
+    pio_sm_set_enabled(pio, sm_reg, false);
+    pio_sm_exec(pio, sm_reg, pio_encode_jmp(offset_reg + ide_reg_offset_top) | pio_encode_sideset(2, 3));
+    pio_sm_set_enabled(pio, sm_reg, true);
+}
+
+int IDE_HOT(ide_pio_poll_wait)(uint32_t timeout_us) {
+    uint32_t end = ide_deadline_us(timeout_us);
+    while (pio_sm_is_rx_fifo_empty(pio, sm_reg)) {
+        if (ide_deadline_reached(end)) {
+            poll_stop();
+            // BSY may have cleared just before the stop
+            if (pio_sm_is_rx_fifo_empty(pio, sm_reg)) return -1;
+            break;
+        }
+        ide_pio_sleep_until(end);
+    }
+    return (int)(pio_sm_get(pio, sm_reg) & 0xFF);
+}
+
+int IDE_HOT(ide_pio_poll)(bool cs1, uint32_t timeout_us) {
+    ide_pio_poll_start(cs1);
+    return ide_pio_poll_wait(timeout_us);
+}
+
+// Data DMA moves word pairs in 32-bit beats, so the buffer must be too
+static __force_inline bool dma_aligned(const void *buf) {
+    return ((uintptr_t)buf & 3) == 0;
+}
+
+// Point the bus at the data register (CS0, A = 0) in the burst's direction
+// and wait for it to settle before the data SM starts strobing
+static void IDE_HOT(select_data)(bool write) {
+    reg_put(reg_word(write, false, 0, 0, ide_reg_offset_top));
+    ide_pio_reg_flush();
+}
+
+// ---------------------------------------------------------------------------
+//  Read — DMA for data bursts, CPU FIFO loop when DMA is disabled
+// ---------------------------------------------------------------------------
+
+void IDE_HOT(ide_pio_read_start)(uint32_t count, uint16_t *buf) {
+    uint32_t t0 = cycles_now();
+    select_data(false);
+
+    read_done = false;
+    dma_channel_set_write_addr(dma_read_chan, buf, false);
+    dma_channel_set_trans_count(dma_read_chan, count / 2, true);
+    pio_set_irq0_source_enabled(pio, pis_interrupt0 + sm_read, true);
+
+    // Push count-1 to start the read burst
+    pio_sm_put(pio, sm_read, count - 1);
+
+    stats.cpu_cycles += cycles_since(t0);
+}
+
+bool IDE_HOT(ide_pio_read_busy)(void) {
+    return !read_done || dma_channel_is_busy(dma_read_chan);
+}
+
+void IDE_HOT(ide_pio_read_wait)(void) {
+    while (!read_done)
+        __wfe();
+
+    // Last word is pushed before 'irq wait' — let DMA drain it
+    uint32_t t0 = cycles_now();
+    while (dma_channel_is_busy(dma_read_chan))
+        tight_loop_contents();
+    stats.cpu_cycles += cycles_since(t0);
+}
+
+static void IDE_HOT(pio_read_cpu)(uint32_t count, uint16_t *buf) {
     // Push count-1 to start the read burst
     pio_sm_put_blocking(pio, sm_read, count - 1);
 
-    for (uint32_t i = 0; i < count; i++) {
-        buf[i] = (uint16_t)pio_sm_get_blocking(pio, sm_read);
+    // First word of each pair lands in the low half (little-endian order)
+    for (uint32_t i = 0; i < count; i += 2) {
+        uint32_t w = pio_sm_get_blocking(pio, sm_read);
+        buf[i]     = (uint16_t)w;
+        buf[i + 1] = (uint16_t)(w >> 16);
     }
 
     // Wait for PIO completion IRQ, then clear it to release the SM
@@ -73,22 +593,170 @@ void ide_pio_read(uint32_t count, uint16_t *buf) {
     pio->irq = 1u << sm_read;
 }
 
-void ide_pio_write(uint32_t count, const uint16_t *buf) {
-    // Data bus to output for the duration of the write
-    pio_sm_set_consecutive_pindirs(pio, sm_write, 0, 16, true);
+void IDE_HOT(ide_pio_read)(uint32_t count, uint16_t *buf) {
+    stats.bursts++;
+    stats.words += count;
+
+    if (dma_enabled && dma_aligned(buf)) {
+        ide_pio_read_start(count, buf);
+        ide_pio_read_wait();
+    } else {
+        uint32_t t0 = cycles_now();
+        select_data(false);
+        pio_read_cpu(count, buf);
+        stats.cpu_cycles += cycles_since(t0);
+    }
+}
+
+// ---------------------------------------------------------------------------
+//  Read chain — N sectors, no CPU between them
+// ---------------------------------------------------------------------------
+
+static __force_inline chain_block_t *chain_step(chain_block_t *b, uint32_t ctrl, volatile void *wr,
+                                                const volatile void *rd, uint32_t count) {
+    b->ctrl = ctrl;
+    b->write_addr = wr;
+    b->count = count;
+    b->read_addr = rd;
+    return b + 1;
+}
+
+void IDE_HOT(ide_pio_read_chain_start)(uint32_t blocks, uint32_t words, uint16_t *buf) {
+    uint32_t t0 = cycles_now();
+    if (blocks > IDE_PIO_CHAIN_MAX) blocks = IDE_PIO_CHAIN_MAX;
+    chain_blocks = blocks;
+    chain_count_word = words - 1;
+
+    chain_words[0] = reg_word(false, false, 7, 0, ide_reg_offset_poll);
+    chain_words[1] = reg_word(false, false, 0, 0, ide_reg_offset_top);
+    reg_facing_write = false;
+
+    dma_timer_set_fraction(chain_timer, 1, chain_ticks);
 
-    // Push count-1, then each data word
+    chain_block_t *b = chain;
+    for (uint32_t s = 0; s < blocks; s++) {
+        b = chain_step(b, ctrl_delay,  chain_dummy, chain_dummy, 2);    // Status not valid yet
+        b = chain_step(b, ctrl_reg_tx, &pio->txf[sm_reg], chain_words, 2);
+        b = chain_step(b, ctrl_reg_rx, &chain_status[s], &pio->rxf[sm_reg], 1);
+        b = chain_step(b, ctrl_delay,  chain_dummy, chain_dummy, 2);
+        b = chain_step(b, ctrl_ack,    &pio->irq, &chain_ack_word, 1);   // previous burst's flag
+        b = chain_step(b, ctrl_count,  &pio->txf[sm_read], &chain_count_word, 1);
+        b = chain_step(b, ctrl_data,   buf + s * words, &pio->rxf[sm_read], words / 2);
+    }
+    chain_step(b, ctrl_data, NULL, NULL, 0);                              // null trigger: done
+
+    chain_done = false;
+    dma_channel_set_read_addr(dma_ctl_chan, chain, true);
+
+    stats.bursts += blocks;
+    stats.words += blocks * words;
+    stats.cpu_cycles += cycles_since(t0);
+}
+
+bool IDE_HOT(ide_pio_read_chain_busy)(void) {
+    return !chain_done;
+}
+
+int IDE_HOT(ide_pio_read_chain_wait)(uint8_t *status, uint32_t timeout_ms) {
+    uint32_t end = ide_deadline_us(timeout_ms * 1000);
+    bool ok = true;
+    while (!chain_done) {
+        if (ide_deadline_reached(end) && !chain_done) { ok = false; break; }
+        ide_pio_sleep_until(end);
+    }
+
+    uint32_t t0 = cycles_now();
+    if (ok) {
+        // Last burst's 'irq wait' follows its final push — release the SM
+        while (!(pio->irq & (1u << sm_read)))
+            tight_loop_contents();
+        pio->irq = 1u << sm_read;
+    } else {
+        // Drive stuck BSY (or gone): stop both DMA channels and both SMs
+        dma_channel_abort(dma_ctl_chan);
+        dma_channel_abort(dma_work_chan);
+        dma_channel_acknowledge_irq0(dma_work_chan);
+        poll_stop();
+        pio_sm_clear_fifos(pio, sm_reg);
+        pio_sm_set_enabled(pio, sm_read, false);
+        pio_sm_clear_fifos(pio, sm_read);
+        pio_sm_restart(pio, sm_read);
+        pio_sm_exec(pio, sm_read, pio_encode_jmp(offset_read) | pio_encode_sideset(1, 1));
+        pio->irq = 1u << sm_read;
+        pio_sm_set_enabled(pio, sm_read, true);
+    }
+    for (uint32_t s = 0; s < chain_blocks && status; s++)
+        status[s] = (uint8_t)chain_status[s];
+    stats.cpu_cycles += cycles_since(t0);
+    return ok ? 0 : -1;
+}
+
+void ide_pio_set_dma(bool enabled) { dma_enabled = enabled; }
+bool IDE_HOT(ide_pio_get_dma)(void) { return dma_enabled; }
+
+void ide_pio_get_stats(ide_pio_stats_t *out) { *out = stats; }
+
+void ide_pio_reset_stats(void) {
+    stats.bursts = 0;
+    stats.words = 0;
+    stats.cpu_cycles = 0;
+}
+
+// ---------------------------------------------------------------------------
+//  Write — DMA-fed data bursts, CPU FIFO loop when DMA is disabled
+// ---------------------------------------------------------------------------
+
+void IDE_HOT(ide_pio_write_start)(uint32_t count, const uint16_t *buf) {
+    uint32_t t0 = cycles_now();
+    select_data(true);                      // also turns the data bus around
+
+    write_done = false;
+    write_count_word = count - 1;
+    dma_channel_set_read_addr(dma_write_chan, buf, false);
+    dma_channel_set_trans_count(dma_write_chan, count / 2, false);
+    pio_set_irq0_source_enabled(pio, pis_interrupt0 + sm_write, true);
+
+    // Count word first; its completion triggers the payload channel
+    dma_channel_set_read_addr(dma_wcount_chan, &write_count_word, true);
+
+    stats.cpu_cycles += cycles_since(t0);
+}
+
+bool IDE_HOT(ide_pio_write_busy)(void) {
+    return !write_done;
+}
+
+void IDE_HOT(ide_pio_write_wait)(void) {
+    // 'irq wait' follows the last strobe, so the FIFO and both channels
+    // are already drained once the flag fires
+    while (!write_done)
+        __wfe();
+}
+
+static void IDE_HOT(pio_write_cpu)(uint32_t count, const uint16_t *buf) {
+    // Push count-1, then the data two words per entry, first in the low half
     pio_sm_put_blocking(pio, sm_write, count - 1);
-    for (uint32_t i = 0; i < count; i++) {
-        pio_sm_put_blocking(pio, sm_write, (uint32_t)buf[i]);
+    for (uint32_t i = 0; i < count; i += 2) {
+        pio_sm_put_blocking(pio, sm_write, buf[i] | ((uint32_t)buf[i + 1] << 16));
     }
 
     // Wait for completion
     while (!(pio->irq & (1u << sm_write)))
         tight_loop_contents();
     pio->irq = 1u << sm_write;
-
-    // Data bus back to input
-    pio_sm_set_consecutive_pindirs(pio, sm_write, 0, 16, false);
 }
 
+void IDE_HOT(ide_pio_write)(uint32_t count, const uint16_t *buf) {
+    stats.bursts++;
+    stats.words += count;
+
+    if (dma_enabled && dma_aligned(buf)) {
+        ide_pio_write_start(count, buf);
+        ide_pio_write_wait();
+    } else {
+        uint32_t t0 = cycles_now();
+        select_data(true);
+        pio_write_cpu(count, buf);
+        stats.cpu_cycles += cycles_since(t0);
+    }
+}
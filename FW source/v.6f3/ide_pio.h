@@ -4,17 +4,124 @@
 #include <stdint.h>
 #include <stdbool.h>
 
-// Initialize PIO state machines for IDE read/write strobes.
+// Burst accounting for the data path (register accesses are not counted).
+// cpu_cycles is clk_sys cycles the CPU spent driving bursts: the whole
+// burst for the CPU loop, setup + completion handling for DMA.
+typedef struct {
+    uint32_t bursts;
+    uint32_t words;
+    uint64_t cpu_cycles;
+} ide_pio_stats_t;
+
+// Initialize PIO state machines for IDE register accesses and data bursts.
+// Takes over GPIO 0-22 and 24-27; only RESET (23) is left to SIO.
 // Must be called after GPIO pad config but before any IDE bus operations.
 void ide_pio_init(void);
 
-// Execute 'count' DIOR strobes and store the 16-bit results in buf[].
-// Caller must set up address, CS, and transceivers (read direction) first.
+// Per-core setup (SysTick for the cycle counts in ide_pio_stats_t).
+// ide_pio_init() covers its own core; the other core calls this first.
+void ide_pio_core_init(void);
+
+// Single 8-bit register access — one FIFO word carries address, chip select,
+// direction and data.  cs1 = control block (CS1) instead of command block.
+// Writes are queued; ide_pio_reg_flush() waits until they reach the bus.
+void    ide_pio_reg_write(bool cs1, uint8_t addr, uint8_t val);
+uint8_t ide_pio_reg_read(bool cs1, uint8_t addr);
+void    ide_pio_reg_flush(void);
+
+// Command images: ide_pio_reg_word() encodes one register write, and
+// ide_pio_reg_burst() plays n of them back-to-back through DMA, returning
+// once the last one has been strobed.
+uint32_t ide_pio_reg_word(bool cs1, uint8_t addr, uint8_t val);
+void     ide_pio_reg_burst(const uint32_t *words, uint32_t n);
+
+// Status poller: ide_reg strobes Status (cs1 = false) or Alt Status until
+// BSY reads clear and returns that status byte.  Reading Status also
+// acknowledges INTRQ.  The CPU sleeps in WFE until the result IRQ; on
+// timeout the poller is stopped and -1 returned.  start/busy/wait split
+// the same operation so other work can overlap it.
+int     ide_pio_poll(bool cs1, uint32_t timeout_us);
+void    ide_pio_poll_start(bool cs1);
+bool    ide_pio_poll_busy(void);
+int     ide_pio_poll_wait(uint32_t timeout_us);
+
+// Deassert both chip selects and disable the transceivers.
+void    ide_pio_bus_idle(void);
+
+// Execute 'count' DIOR strobes on the data register and store the 16-bit
+// results in buf[].  Address, CS and transceiver direction are set here.
+// count must be even: the FIFOs carry two words per entry.  Bursts go
+// through DMA (CPU sleeps in WFE until the completion IRQ) unless DMA has
+// been disabled with ide_pio_set_dma(false) or buf is not 4-byte aligned.
 void ide_pio_read(uint32_t count, uint16_t *buf);
 
-// Execute 'count' DIOW strobes, writing 16-bit words from buf[].
-// Caller must set up address, CS, and transceivers (write direction) first.
-// Automatically toggles data bus direction (output during write, input after).
+// WFE until an event or the time_us_32() deadline 'end' (ide_deadline_us),
+// whichever comes first.  Callers recheck what they wait for.
+void ide_pio_sleep_until(uint32_t end);
+
+// Split form of a DMA read burst (buf 4-byte aligned): start returns as
+// soon as the channel and SM are armed; the caller may do other work until busy() goes false, then
+// must call wait() before touching the bus again.
+void ide_pio_read_start(uint32_t count, uint16_t *buf);
+bool ide_pio_read_busy(void);
+void ide_pio_read_wait(void);
+
+// Read chain: 'blocks' (<= IDE_PIO_CHAIN_MAX) back-to-back DRQ blocks of
+// 'words' (even) words each, with no CPU involvement between them.  For
+// each block a timer-paced step waits out the 400 ns before Status is
+// valid, the poller waits for BSY=0, the Status byte is stored, and the
+// block is burst into the next slot of buf (4-byte aligned).  The CPU is
+// woken once, when the chain ends.  DRQ/ERR are not acted on mid-chain:
+// wait() copies the per-block status to status[] for the caller to check,
+// and returns -1 if the chain timed out (engine stopped, contents undefined).
+#define IDE_PIO_CHAIN_MAX   16
+
+void ide_pio_read_chain_start(uint32_t blocks, uint32_t words, uint16_t *buf);
+bool ide_pio_read_chain_busy(void);
+int  ide_pio_read_chain_wait(uint8_t *status, uint32_t timeout_ms);
+
+// Execute 'count' (even) DIOW strobes on the data register, writing 16-bit
+// words from buf[].  The data bus stays driven until the next read turns it round.
+// Bursts are DMA-fed (count word, then payload) unless DMA is disabled.
 void ide_pio_write(uint32_t count, const uint16_t *buf);
 
+// Split form of a DMA write burst.  buf must be 4-byte aligned and stay
+// valid until wait() returns.
+void ide_pio_write_start(uint32_t count, const uint16_t *buf);
+bool ide_pio_write_busy(void);
+void ide_pio_write_wait(void);
+
+// Select ATA PIO timing mode 0-4.  Dividers for 8-bit register cycles and
+// 16-bit data cycles are recomputed from the current clk_sys frequency, so
+// call again after changing the system clock.  Mode 0 after init.
+void    ide_pio_set_mode(uint8_t mode);
+uint8_t ide_pio_get_mode(void);
+
+// Stretch every timing minimum by 'pct' percent (0 = exact spec timing).
+// Kept across ide_pio_set_mode() calls.
+void    ide_pio_set_margin(uint8_t pct);
+uint8_t ide_pio_get_margin(void);
+
+// Everything ide_pio_set_mode() and ide_pio_set_margin() compute, so a
+// device switch can restore it without clock_get_hz() and 64-bit divides.
+// div_data == 0: not computed yet, set_timing() falls back to set_mode().
+typedef struct {
+    uint32_t div_data, div_reg;
+    uint16_t chain_ticks;
+    uint8_t  mode, margin;
+} ide_pio_timing_t;
+
+void    ide_pio_get_timing(ide_pio_timing_t *t);
+void    ide_pio_set_timing(const ide_pio_timing_t *t);
+
+// Effective strobe cycle time in ns for data (true) or register cycles.
+uint32_t ide_pio_cycle_ns(bool data);
+
+// Select DMA (default) or the CPU FIFO loop for data bursts (both directions).
+void ide_pio_set_dma(bool enabled);
+bool ide_pio_get_dma(void);
+
+void ide_pio_get_stats(ide_pio_stats_t *out);
+void ide_pio_reset_stats(void);
+
 #endif
@@ -9,7 +9,12 @@
 #include <stdarg.h>
 #include <math.h>
 #include "pico/stdlib.h"
+#include "hardware/structs/xip_ctrl.h"
 #include "ide.h"
+#include "ide_pio.h"
+#include "tune.h"
+#include "badmap.h"
+#include "scan.h"
 #include "config.h"
 #include "pico/util/queue.h"
 
@@ -21,7 +26,8 @@ extern queue_t cdc_tx_queue;
 extern queue_t cdc_rx_queue;
 extern volatile bool cdc_connected;
 extern volatile bool is_mounted;
-extern volatile bool media_changed_waiting;
+extern volatile uint8_t mounted_luns;
+extern volatile uint8_t media_changed_luns;
 
 static void cdc_putchar(char c) {
     queue_add_blocking(&cdc_tx_queue, &c);
@@ -344,12 +350,18 @@ static void update_main_menu(void) {
 // ---------------------------------------------------------------------------
 
 static void update_features_menu(void) {
-    const char *labels[] = {"Write Protect", "Auto Mount at Start", "IORDY", "INTRQ", "Debug Mode"};
+    const char *labels[] = {"Write Protect", "Auto Mount at Start", "IORDY", "INTRQ", "CHS Track Split", "Fast-Fail Timeout", "Retry Known-Bad", "Write Cache", "Read Look-Ahead", "Auto Tune Bus", "Debug Mode"};
     const char *helps[] = {
-        "Prevents any write commands from reaching the HDD.",
+        "Prevents any write commands from reaching the current HDD.  Set for master and slave separately.",
         "Automatically mounts the drive to USB on power-up sequence.",
         "Enables hardware IORDY (pin 27) flow control on the IDE bus.  Toggling this may help with picky drives.",
         "Enables hardware INTRQ (pin 28) for faster IDE command completion.  Toggling this may help with picky drives.",
+        "CHS mode: ends each command at a track boundary.  For old drives that mishandle multi-track transfers.",
+        "Longest wait on a read or write before it is reported as failed, so the host doesn't reset the bus.",
+        "Read sectors in the bad-sector map again instead of failing them at once.  Sectors that read clean are unmapped.",
+        "Lets the drive cache writes and stream them at media speed.  Flushed on unmount and eject; unmount before power-off.",
+        "Drive reads ahead of small host reads.  Auto: measured on first mount of each drive, kept if not slower.",
+        "Tests bus timing, IORDY and INTRQ combinations and keeps the fastest error-free one.  F10 to save.",
         "Open low-level drive diagnostics and register status screen."
     };
 
@@ -359,17 +371,24 @@ static void update_features_menu(void) {
     emit_n(BOX_HL, 24);
     cdc_puts(BOX_MR);
 
-    for (int i = 0; i < 5; i++) {
+    for (int i = 0; i < 11; i++) {
         int row = 4 + i;
         cdc_printf("\033[%d;4H" FG_WHITE "%-25s", row, labels[i]);
         cdc_printf("\033[%d;35H" FG_YELLOW "[", row);
         cdc_puts(i == config.feat_selected ? SEL_RED : FG_YELLOW);
 
-        if (i == 0)      cdc_printf("%-8s", config.drive_write_protected ? "Enabled" : "Disabled");
+        if (i == 0)      cdc_printf("%-8s", config_lun(config.dev_base)->write_protected ? "Enabled" : "Disabled");
         else if (i == 1) cdc_printf("%-8s", config.auto_mount ? "Enabled" : "Disabled");
-        else if (i == 2) cdc_printf("%-8s", config.iordy_enabled ? "Enabled" : "Disabled");
-        else if (i == 3) cdc_printf("%-8s", config.intrq_enabled ? "Enabled" : "Disabled");
-        else if (i == 4) cdc_printf("%-8s", "Enter");
+        else if (i == 2) cdc_printf("%-8s", ide_get_iordy() ? "Enabled" : "Disabled");
+        else if (i == 3) cdc_printf("%-8s", ide_get_intrq() ? "Enabled" : "Disabled");
+        else if (i == 4) cdc_printf("%-8s", config.chs_track_split ? "Enabled" : "Disabled");
+        else if (i == 5) cdc_printf("%2u sec  ", (unsigned)(config.fail_ceiling_ms / 1000));
+        else if (i == 6) cdc_printf("%-8s", config.retry_known_bad ? "Enabled" : "Disabled");
+        else if (i == 7) cdc_printf("%-8s", config.write_cache ? "Enabled" : "Disabled");
+        else if (i == 8) cdc_printf("%-8s", config.lookahead == LOOKAHEAD_ON ? "Enabled" :
+                                            config.lookahead == LOOKAHEAD_OFF ? "Disabled" : "Auto");
+        else if (i == 9) cdc_printf("%-8s", config_lun(config.dev_base)->tuned ? "Tuned" : "Enter");
+        else if (i == 10) cdc_printf("%-8s", "Enter");
 
         cdc_puts(RESET BG_BLUE FG_WHITE "]");
         if (i == config.feat_selected) print_help(helps[i]);
@@ -610,7 +629,7 @@ static void debug_print(int line_idx, const char *color, const char *fmt, ...) {
 
 static void debug_cls(void) { for (int i = 0; i < 17; i++) debug_print(i, FG_WHITE, ""); }
 
-static void draw_debug_overlay(void) {
+static void draw_overlay(const char *title, const char *keys) {
     int box_w = 72, box_h = 20, sc = 5, sr = 3;
     int ix = sc+2, iy = sr+1, iw = box_w-4, ih = box_h-3;
 
@@ -631,12 +650,16 @@ static void draw_debug_overlay(void) {
     cdc_printf("\033[%d;%dH", sr+box_h-1, sc);
     cdc_puts(BOX_BL); emit_n(BOX_HH, 70); cdc_puts(BOX_BR);
 
-    draw_at(sc+29, sr, "[ Debug Mode ]");
-    cdc_printf("\033[%d;%dH" FG_WHITE BG_BLUE " ESC: Return  I: IDENT  T: Task File  E: Errors  S: Seek  R: Reset", sr+box_h-2, sc+3);
+    draw_at(sc + (box_w - (int)strlen(title)) / 2, sr, title);
+    cdc_printf("\033[%d;%dH" FG_WHITE BG_BLUE "%s", sr+box_h-2, sc+3, keys);
     cdc_puts(RESET);
     cdc_flush();
 }
 
+static void draw_debug_overlay(void) {
+    draw_overlay("[ Debug Mode ]", " ESC I:IDENT T:Task E:Err S:Seek R:Reset B:Bench X:XIP M:Map V:Scan");
+}
+
 static void run_debug_identify(void) {
     debug_cls();
     debug_print(0, FG_YELLOW, "Sending IDENTIFY DEVICE (0xEC)...");
@@ -676,8 +699,10 @@ static void run_debug_identify(void) {
         debug_print(12, FG_WHITE, "Capacity:         %lu Sectors (~%lu MB)", (unsigned long)lba28_cap, (unsigned long)mb);
     }
     debug_print(14, FG_YELLOW, "[Advanced]");
-    debug_print(15, FG_WHITE, "DMA Support: %04X  PIO Support: %04X", id[49], id[64]);
-    debug_print(16, FG_WHITE, "ATA Major Ver: %04X", id[80]);
+    debug_print(15, FG_WHITE, "DMA Support: %04X  PIO Support: %04X  Multiple: %u (max %u, cur %u)",
+                id[49], id[64], ide_get_multiple(), id[47] & 0xFF, (id[59] & 0x0100) ? id[59] & 0xFF : 0);
+    debug_print(16, FG_WHITE, "ATA Major Ver: %04X  Best PIO: %u  Bus: PIO %u (%lu ns)",
+                id[80], ide_best_pio_mode(id, ide_get_iordy()), ide_pio_get_mode(), (unsigned long)ide_pio_cycle_ns(true));
 }
 
 static void run_debug_taskfile(void) {
@@ -687,6 +712,143 @@ static void run_debug_taskfile(void) {
     const char *sc = (tf[7] & 0x81) ? "\033[91;1m" : "\033[92m";
     debug_print(0, FG_RED, "[Task File] " FG_WHITE "ERR:%02X SEC:%02X SN:%02X CL:%02X CH:%02X DH:%02X ST:%s%02X" RESET,
                 tf[1], tf[2], tf[3], tf[4], tf[5], tf[6], sc, tf[7]);
+    debug_print(2, FG_WHITE, "Register writes elided by shadow taskfile: %lu", (unsigned long)ide_get_elided());
+    debug_print(3, FG_WHITE, "INTRQ completions missed (Alt Status fallback): %lu",
+                (unsigned long)ide_get_intrq_missed());
+    const ide_bus_t *bus = ide_get_bus();
+    if (bus->probed) {
+        char diag[16] = "not run";
+        if (bus->diag_ok) snprintf(diag, sizeof(diag), "%02Xh", bus->diag);
+        debug_print(4, FG_WHITE, "Bus: Master %s  Slave %s  Diagnostic: %s",
+                    (bus->present & IDE_DEV_MASTER) ? "present" : "-",
+                    (bus->present & IDE_DEV_SLAVE) ? "present" : "-", diag);
+    }
+
+    static const char *const cls[] = {"Spin-up", "Seek", "Read", "Write"};
+    debug_print(5, FG_YELLOW, "Timeouts   Budget ms   Learnt p99 us   Expired");
+    for (int i = 0; i < IDE_TO_CLASSES; i++) {
+        char p99[12] = "-";
+        if (ide_timeout_p99_us((ide_to_t)i))
+            snprintf(p99, sizeof(p99), "%lu", (unsigned long)ide_timeout_p99_us((ide_to_t)i));
+        debug_print(6 + i, FG_WHITE, "%-8s   %9lu   %13s   %7lu", cls[i],
+                    (unsigned long)ide_timeout_ms((ide_to_t)i), p99,
+                    (unsigned long)ide_timeout_expired((ide_to_t)i));
+    }
+}
+
+static void run_debug_badmap(void) {
+    debug_cls();
+    uint32_t n = badmap_extents();
+    debug_print(0, FG_RED, "[Bad Sector Map] " FG_WHITE "%lu extents, %llu sectors",
+                (unsigned long)n, (unsigned long long)badmap_sectors());
+    debug_print(1, FG_WHITE, "Mapped sectors are %s", config.retry_known_bad ? "read again (Retry Known-Bad)" : "failed without a read");
+    if (badmap_dropped())
+        debug_print(2, FG_RED, "Map full: %lu bad areas not recorded", (unsigned long)badmap_dropped());
+
+    uint64_t lba;
+    uint32_t len;
+    for (uint32_t i = 0; i < 12 && badmap_get(i, &lba, &len); i++)
+        debug_print(3 + i, FG_WHITE, "LBA %12llu - %-12llu (%lu)", (unsigned long long)lba,
+                    (unsigned long long)(lba + len - 1), (unsigned long)len);
+    if (n > 12) debug_print(15, FG_WHITE, "... %lu more", (unsigned long)(n - 12));
+
+    debug_print(16, FG_YELLOW, "C: Clear map   Any other key: Back");
+    int k;
+    while ((k = get_input()) == -1) tight_loop_contents();
+    if (k == 'c' || k == 'C') {
+        badmap_clear();
+        debug_print(16, FG_GREEN, "Map cleared.");
+    } else {
+        debug_print(16, FG_WHITE, "");
+    }
+}
+
+// Surface scan — READ VERIFY of the whole drive, drawn as a heatmap of
+// 64 x 10 cells, each showing the worst chunk that fell inside it.
+#define HEAT_W      64
+#define HEAT_H      10
+#define HEAT_CELLS  (HEAT_W * HEAT_H)
+
+static uint8_t  heat[HEAT_CELLS];       // 0 = not scanned, else class + 1
+static uint32_t scan_shown_ms;
+static const char *const heat_glyph[SCAN_CLASSES + 1] = {
+    "\033[90m-", FG_GREEN ".", FG_YELLOW "o", FG_RED "O", "\033[91;1mX"
+};
+
+static void heat_draw(int cell) {
+    cdc_printf("\033[%d;%dH\033[40m%s", 4 + 3 + cell / HEAT_W, 7 + cell % HEAT_W, heat_glyph[heat[cell]]);
+    cdc_puts(RESET);
+}
+
+static void scan_counts(const scan_result_t *r) {
+    debug_print(0, FG_WHITE, "LBA %llu / %llu  (%lu%%)", (unsigned long long)r->done,
+                (unsigned long long)r->total, (unsigned long)(r->done * 100 / r->total));
+    debug_print(14, FG_WHITE, "OK %lu  " FG_YELLOW "Slow %lu  " FG_RED "Very slow %lu  Error %lu"
+                FG_WHITE "  Median %lu ms  Worst %lu ms", (unsigned long)r->n[SCAN_OK], (unsigned long)r->n[SCAN_SLOW],
+                (unsigned long)r->n[SCAN_VERY_SLOW], (unsigned long)r->n[SCAN_ERROR],
+                (unsigned long)(r->median_us / 1000), (unsigned long)(r->max_us / 1000));
+}
+
+static bool scan_progress(const scan_chunk_t *c, const scan_result_t *r) {
+    // A chunk that straddles cells marks each of them
+    int first = (int)(c->lba * HEAT_CELLS / r->total);
+    int last = (int)((c->lba + c->count - 1) * HEAT_CELLS / r->total);
+    for (int i = first; i <= last; i++) {
+        if (heat[i] < c->cls + 1) {
+            heat[i] = (uint8_t)(c->cls + 1);
+            heat_draw(i);
+        }
+    }
+    if (c->cls == SCAN_ERROR)
+        debug_print(15, FG_RED, "Last error: LBA %llu%s", (unsigned long long)c->bad_lba,
+                    c->no_answer ? " (no answer, chunk skipped)" : " (added to bad map)");
+
+    // Text is throttled; a whole drive is millions of chunks
+    uint32_t now = to_ms_since_boot(get_absolute_time());
+    if (now - scan_shown_ms >= 250) {
+        scan_shown_ms = now;
+        scan_counts(r);
+        cdc_flush();
+    }
+    return cdc_getchar_timeout_us(0) != KEY_ESC;
+}
+
+static void run_surface_scan(void) {
+    draw_overlay("[ Surface Scan ]", " ESC: Abort");
+    debug_cls();
+
+    if (is_mounted) {
+        debug_print(0, FG_RED, "ERROR: Unmount the drive first.");
+    } else {
+        debug_print(1, FG_WHITE, "READ VERIFY in %u-sector chunks:  " FG_GREEN ". ok  " FG_YELLOW "o >%ux median  "
+                    FG_RED "O >%ux  " "\033[91;1mX error", SCAN_CHUNK, SCAN_SLOW_X, SCAN_VERY_SLOW_X);
+        memset(heat, 0, sizeof(heat));
+        for (int i = 0; i < HEAT_CELLS; i++) heat_draw(i);
+        scan_shown_ms = 0;
+
+        scan_result_t r;
+        absolute_time_t t0 = get_absolute_time();
+        scan_status_t st = scan_surface(scan_progress, &r);
+        uint32_t secs = (uint32_t)(absolute_time_diff_us(t0, get_absolute_time()) / 1000000);
+
+        if (st == SCAN_NO_GEOMETRY) {
+            debug_print(0, FG_RED, "ERROR: No geometry. Run Auto Detect first.");
+        } else {
+            scan_counts(&r);
+            if (st == SCAN_DONE)
+                debug_print(16, FG_GREEN, "Done in %lu s - %lu bad sectors added to map.",
+                            (unsigned long)secs, (unsigned long)r.bad_sectors);
+            else if (st == SCAN_ABORTED)
+                debug_print(16, FG_YELLOW, "Aborted after %lu s - %lu bad sectors added to map.",
+                            (unsigned long)secs, (unsigned long)r.bad_sectors);
+            else
+                debug_print(16, FG_RED, "Drive stopped responding at LBA %llu.", (unsigned long long)r.done);
+        }
+    }
+
+    cdc_printf("\033[%d;%dH" FG_WHITE BG_BLUE " Press any key to return  " RESET, 21, 8);
+    cdc_flush();
+    while (get_input() == -1) tight_loop_contents();
 }
 
 static void run_debug_errors(void) {
@@ -733,19 +895,239 @@ static void run_seek_test(void) {
     sleep_ms(50);
 }
 
+// Burst benchmark — IDENTIFY's 256-word data phase timed through the CPU
+// FIFO loop and through DMA.  Needs no geometry, so it runs on any drive.
+static bool bench_pass(bool dma, int reps, uint32_t *us_per, uint32_t *cyc_per) {
+    uint16_t id[256] __attribute__((aligned(4)));   // DMA moves word pairs
+    ide_pio_stats_t st;
+    ide_pio_set_dma(dma);
+    ide_pio_reset_stats();
+    uint32_t t0 = time_us_32();
+    for (int i = 0; i < reps; i++)
+        if (!ide_identify(id)) { ide_pio_set_dma(true); return false; }
+    uint32_t elapsed = time_us_32() - t0;
+    ide_pio_get_stats(&st);
+    ide_pio_set_dma(true);
+    if (!st.bursts) return false;
+    *us_per  = elapsed / (uint32_t)reps;
+    *cyc_per = (uint32_t)(st.cpu_cycles / st.bursts);
+    return true;
+}
+
+static void run_pio_bench(void) {
+    debug_cls();
+    debug_print(0, FG_YELLOW, "Burst Benchmark: 32 x IDENTIFY (256-word data phase)");
+
+    uint32_t cpu_us, cpu_cyc, dma_us, dma_cyc;
+    if (!bench_pass(false, 32, &cpu_us, &cpu_cyc) || !bench_pass(true, 32, &dma_us, &dma_cyc)) {
+        debug_print(2, FG_RED, "ERROR: IDENTIFY failed - drive not ready.");
+        return;
+    }
+
+    debug_print(2, FG_WHITE, "               us/cmd    CPU cycles/burst");
+    debug_print(3, FG_WHITE, "CPU FIFO loop  %-8lu  %lu", (unsigned long)cpu_us, (unsigned long)cpu_cyc);
+    debug_print(4, FG_WHITE, "DMA + IRQ      %-8lu  %lu", (unsigned long)dma_us, (unsigned long)dma_cyc);
+    if (dma_cyc)
+        debug_print(6, FG_GREEN, "CPU cost per burst reduced %lux",
+                    (unsigned long)(cpu_cyc / dma_cyc));
+}
+
+// Sector path cost — XIP cache traffic and CPU cycles per sector over a run
+// of READ SECTORS.  The XIP counters are shared by both cores, so core 0's
+// USB loop shows up as a small floor; a flash-resident sector path
+// (ATABOY_HOT_IN_FLASH build) adds its misses on top of that.
+#define COST_SECTORS    64
+#define COST_CHUNK      16
+
+static void run_sector_cost(void) {
+    static uint8_t buf[COST_CHUNK * 512] __attribute__((aligned(4)));
+    debug_cls();
+    debug_print(0, FG_YELLOW, "Sector Path Cost: %d sectors from LBA 0 (%s)", COST_SECTORS,
+                ATABOY_HOT_IN_FLASH ? "XIP flash" : "SRAM");
+
+    ide_pio_stats_t st;
+    ide_pio_reset_stats();
+    xip_ctrl_hw->ctr_hit = 0;               // any write clears
+    xip_ctrl_hw->ctr_acc = 0;
+    uint32_t t0 = time_us_32();
+    for (uint32_t lba = 0; lba < COST_SECTORS; lba += COST_CHUNK) {
+        if (ide_read_sectors_raw(lba, COST_CHUNK, buf) < 0) {
+            debug_print(2, FG_RED, "ERROR: Read failed - set geometry with Auto Detect first.");
+            return;
+        }
+    }
+    uint32_t elapsed = time_us_32() - t0;
+    uint32_t hit = xip_ctrl_hw->ctr_hit, acc = xip_ctrl_hw->ctr_acc;
+    ide_pio_get_stats(&st);
+
+    debug_print(2, FG_WHITE, "XIP accesses   %-10lu  per sector %lu", (unsigned long)acc,
+                (unsigned long)(acc / COST_SECTORS));
+    debug_print(3, FG_WHITE, "XIP misses     %-10lu  per sector %lu", (unsigned long)(acc - hit),
+                (unsigned long)((acc - hit) / COST_SECTORS));
+    debug_print(4, FG_WHITE, "CPU cycles     per sector %lu",
+                (unsigned long)(st.cpu_cycles / COST_SECTORS));
+    debug_print(5, FG_WHITE, "Wall time      per sector %lu us", (unsigned long)(elapsed / COST_SECTORS));
+}
+
+// ---------------------------------------------------------------------------
+//  Auto Tune Bus — Features menu, uses the debug overlay frame
+// ---------------------------------------------------------------------------
+
+static bool tune_progress(const tune_result_t *r, int done, int total) {
+    debug_print(2, FG_WHITE, "Combination %d / %d", done, total);
+    debug_print(3, r->pass ? FG_GREEN : FG_RED, "PIO %u +%3u%%  IORDY %-3s  INTRQ %-3s  %-4s  %lu us",
+                r->mode, r->margin, r->iordy ? "On" : "Off", r->intrq ? "On" : "Off",
+                r->pass ? "PASS" : "FAIL", (unsigned long)r->us);
+    return cdc_getchar_timeout_us(0) != KEY_ESC;
+}
+
+static void run_auto_tune(void) {
+    draw_overlay("[ Auto Tune Bus ]", " ESC: Abort");
+    debug_cls();
+
+    uint16_t id[256];
+    if (!hdd_model_raw[0] || !ide_identify(id)) {
+        debug_print(0, FG_RED, "ERROR: No drive. Run Auto Detect first.");
+    } else {
+        debug_print(0, FG_YELLOW, "Tuning %s - loopback + read passes...", hdd_model_raw);
+        tune_result_t best;
+        tune_status_t st = tune_bus(id, tune_progress, &best);
+        if (st == TUNE_OK) {
+            debug_print(5, FG_GREEN, "Best: PIO %u, timing +%u%% (incl. safety margin)", best.mode, best.margin);
+            debug_print(6, FG_WHITE, "IORDY %s, INTRQ %s, data cycle %lu ns",
+                        best.iordy ? "Enabled" : "Disabled", best.intrq ? "Enabled" : "Disabled",
+                        (unsigned long)ide_pio_cycle_ns(true));
+            debug_print(8, FG_YELLOW, "Press F10 to save to EEPROM.");
+        } else if (st == TUNE_ABORTED) {
+            debug_print(5, FG_YELLOW, "Aborted - previous settings restored.");
+        } else if (st == TUNE_NO_TEST) {
+            debug_print(5, FG_RED, "Drive has no READ/WRITE BUFFER and no geometry is set.");
+            debug_print(6, FG_WHITE, "Set geometry first so read passes can be used.");
+        } else {
+            debug_print(5, FG_RED, "No combination ran error-free - settings unchanged.");
+        }
+    }
+
+    cdc_printf("\033[%d;%dH" FG_WHITE BG_BLUE " Press any key to return  " RESET, 21, 8);
+    cdc_flush();
+    while (get_input() == -1) tight_loop_contents();
+}
+
 // ---------------------------------------------------------------------------
 //  Sync local state to/from config_t
 // ---------------------------------------------------------------------------
 
+// The menus show and edit the geometry of the config.dev_base drive
 static void sync_from_config(void) {
-    cur_cyls = config.cyls; cur_heads = config.heads; cur_spt = config.spt;
-    use_lba_mode = config.use_lba_mode; total_lba_sectors = config.lba_sectors;
+    const lun_config_t *l = config_lun(config.dev_base);
+    cur_cyls = l->cyls; cur_heads = l->heads; cur_spt = l->spt;
+    use_lba_mode = l->use_lba_mode; total_lba_sectors = l->lba_sectors;
     ide_select_device(config.dev_base);
 }
 
 static void sync_to_config(void) {
-    config.cyls = cur_cyls; config.heads = cur_heads; config.spt = cur_spt;
-    config.use_lba_mode = use_lba_mode; config.lba_sectors = total_lba_sectors;
+    lun_config_t *l = config_lun(config.dev_base);
+    l->cyls = cur_cyls; l->heads = cur_heads; l->spt = cur_spt;
+    l->use_lba_mode = use_lba_mode; l->lba_sectors = total_lba_sectors;
+}
+
+// Auto Detect reuses this boot's discovery while it holds an identified
+// drive, so the bus is only probed again after a failure.  With two
+// drives on the cable, detecting again switches to the other one.
+static uint8_t detect_device(void) {
+    uint8_t base = ide_discovered_base();
+    if (!base || !ide_cached_identify(base)) return ide_probe_devices();
+    uint8_t other = (base == 0xB0) ? 0xA0 : 0xB0;
+    if (hdd_model_raw[0] && ide_cached_identify(other)) return other;
+    return base;
+}
+
+// Read look-ahead per config.lookahead at mount, for the selected drive.
+// Auto benchmarks a drive the first time it is seen as master or slave and
+// keeps the answer in that LUN's settings under its IDENTIFY tag (F10
+// saves it).  Drives that refuse the setting keep their default.
+static void apply_lookahead(const uint16_t *id) {
+    if (config.lookahead != LOOKAHEAD_AUTO) {
+        ide_set_lookahead(config.lookahead == LOOKAHEAD_ON);
+        return;
+    }
+    lun_config_t *l = config_lun(ide_get_device());
+    uint16_t tag = ide_identify_tag(id);
+    if (l->lookahead_tag == tag) {
+        ide_set_lookahead(l->lookahead_keep);
+    } else if (tune_lookahead(&l->lookahead_keep, NULL, NULL)) {
+        l->lookahead_tag = tag;
+    }
+}
+
+// Bring up each drive Mount exposes: the one in the menus (even when
+// force-detected) and the other one if discovery identified it, each only
+// with geometry set.  Returns the LUN mask, bit 0 master, bit 1 slave.
+static uint8_t prepare_luns(void) {
+    static const uint8_t bases[] = {0xA0, 0xB0};
+    uint8_t mask = 0;
+    for (int i = 0; i < 2; i++) {
+        const uint16_t *id = ide_cached_identify(bases[i]);
+        const lun_config_t *l = config_lun(bases[i]);
+        if (bases[i] != config.dev_base && !id) continue;
+        if (!config_lun_sectors(l)) continue;
+
+        ide_select_device(bases[i]);
+        uint16_t id_buf[256];
+        if (id) {
+            memcpy(id_buf, id, sizeof(id_buf));
+            ide_negotiate_pio_mode(id_buf);
+            ide_negotiate_multiple(id_buf);
+            ide_set_write_cache(id_buf, config.write_cache);
+            badmap_select(id_buf);
+        }
+        if (!l->use_lba_mode)
+            ide_set_geometry(l->heads, l->spt);
+        if (id) apply_lookahead(id_buf);
+        mask |= (uint8_t)(1u << i);
+    }
+    ide_select_device(config.dev_base);
+    return mask;
+}
+
+static void mount_luns(uint8_t mask) {
+    mounted_luns = mask;
+    media_changed_luns = mask;
+    is_mounted = true;
+}
+
+// USB stops issuing commands once it sees is_mounted clear under the bus
+// lock; then each drive's cache is flushed
+static void unmount_luns(void) {
+    is_mounted = false;
+    ide_bus_lock();
+    for (int i = 0; i < 2; i++) {
+        if (!(mounted_luns & (1u << i))) continue;
+        ide_select_device(i ? 0xB0 : 0xA0);
+        ide_flush_cache();
+    }
+    ide_select_device(config.dev_base);
+    ide_bus_unlock();
+    mounted_luns = 0;
+    badmap_service(true);
+}
+
+// Write Cache toggled in the Features menu: apply to a detected drive now
+static void apply_write_cache(void) {
+    uint16_t id[256];
+    if (hdd_model_raw[0] && ide_identify(id)) ide_set_write_cache(id, config.write_cache);
+}
+
+// IORDY / INTRQ toggled in the Features menu: the default for drives
+// without an Auto Tune result, and this drive's own if it has one.  PIO
+// modes 3-4 depend on IORDY, so the mode follows the setting.
+static void apply_handshake(bool iordy, bool intrq) {
+    uint16_t id[256];
+    lun_config_t *l = config_lun(config.dev_base);
+    config.iordy_enabled = l->tune_iordy = iordy;
+    config.intrq_enabled = l->tune_intrq = intrq;
+    ide_set_handshake(iordy, intrq);
+    if (hdd_model_raw[0] && ide_identify(id)) ide_negotiate_pio_mode(id);
 }
 
 // ---------------------------------------------------------------------------
@@ -755,41 +1137,26 @@ static void sync_to_config(void) {
 static void try_auto_mount(void) {
     if (!config.auto_mount) return;
 
-    bool has_geo = (config.use_lba_mode && config.lba_sectors > 0) ||
-                   (!config.use_lba_mode && config.cyls > 0 && config.heads > 0 && config.spt > 0);
-    if (!has_geo) return;
-
-    // Wait for drive to spin up
-    sleep_ms(5000);
-
-    ide_select_device(config.dev_base);
-    ide_reset_drive();
-
-    // Poll drive ready
-    uint32_t start = to_ms_since_boot(get_absolute_time());
-    bool ready = false;
-    while (to_ms_since_boot(get_absolute_time()) - start < 5000) {
-        uint8_t st = ide_read_reg(7);
-        if (!(st & 0x80) && (st & 0x40)) { ready = true; break; }
-        sleep_ms(10);
-    }
-    if (!ready) return;
+    if (!config_lun_sectors(&config.lun[0]) && !config_lun_sectors(&config.lun[1])) return;
 
-    uint16_t id_buf[256];
-    if (!ide_identify(id_buf)) return;
+    // Discovery waits out power-up and spin-up on the drives' own status;
+    // Auto Detect reuses its result
+    uint8_t base = ide_probe_devices();
+    const uint16_t *id = base ? ide_cached_identify(base) : NULL;
+    if (!id) return;
+    config.dev_base = base;                 // last drive used, else the one found
+    sync_from_config();
+    uint8_t luns = prepare_luns();
+    if (!luns) return;
 
     // Fill model string for display
     for (int i = 0; i < 20; i++) {
-        uint16_t val = id_buf[27+i];
+        uint16_t val = id[27+i];
         hdd_model_raw[i*2] = (char)(val>>8); hdd_model_raw[i*2+1] = (char)(val&0xFF);
     }
     hdd_model_raw[40] = '\0'; sanitize_identify_model(hdd_model_raw);
 
-    if (!config.use_lba_mode)
-        ide_set_geometry(config.heads, config.spt);
-
-    is_mounted = true;
-    media_changed_waiting = true;
+    mount_luns(luns);
 }
 
 // ---------------------------------------------------------------------------
@@ -797,6 +1164,7 @@ static void try_auto_mount(void) {
 // ---------------------------------------------------------------------------
 
 void core1_entry(void) {
+    ide_pio_core_init();                    // 'B' and 'X' count cycles here
     sync_from_config();
     try_auto_mount();
     bool trigger_overlay = false;
@@ -809,6 +1177,7 @@ void core1_entry(void) {
     }
 
     while (true) {
+        badmap_service(false);
         bool connected = cdc_connected;
         if (connected && !last_cdc_connected) { sleep_ms(200); needs_full_redraw = true; }
         last_cdc_connected = connected;
@@ -845,7 +1214,8 @@ void core1_entry(void) {
             }
         } else if (current_screen == SCREEN_MOUNTED) {
             if (trigger_overlay) {
-                draw_confirm_box("Drive mounted!  Press 'U' to Unmount");
+                draw_confirm_box(mounted_luns == 0x03 ? "Drives mounted!  Press 'U' to Unmount" :
+                                                        "Drive mounted!  Press 'U' to Unmount");
                 trigger_overlay = false;
             }
         } else if (current_screen == SCREEN_DEBUG) {
@@ -866,6 +1236,7 @@ void core1_entry(void) {
                 show_detect_result = false; hdd_status_text[0] = '\0';
                 force_detect = false;
                 strcpy(hdd_model_raw, "Manually Forced Drive");
+                badmap_select(NULL);
 
                 // Force geometry — manual entry only, no IDENTIFY data
                 uint16_t dummy_id[256];
@@ -920,12 +1291,18 @@ void core1_entry(void) {
             else if (k == 't' || k == 'T') run_debug_taskfile();
             else if (k == 'e' || k == 'E') run_debug_errors();
             else if (k == 's' || k == 'S') { run_seek_test(); current_screen = SCREEN_DEBUG; needs_full_redraw = true; }
+            else if (k == 'b' || k == 'B') run_pio_bench();
+            else if (k == 'x' || k == 'X') run_sector_cost();
+            else if (k == 'm' || k == 'M') run_debug_badmap();
+            else if (k == 'v' || k == 'V') { run_surface_scan(); needs_full_redraw = true; }
             else if (k == 'r' || k == 'R') {
                 debug_cls();
                 debug_print(0, FG_YELLOW, "Resetting drive...");
-                ide_reset_drive();
-                bool rdy = ide_wait_until_ready(5000);
-                debug_print(1, rdy ? FG_GREEN : FG_RED, rdy ? "Drive ready." : "Drive not responding.");
+                uint32_t t0 = to_ms_since_boot(get_absolute_time());
+                bool rdy = ide_reset_drive();
+                uint32_t ms = to_ms_since_boot(get_absolute_time()) - t0;
+                if (rdy) debug_print(1, FG_GREEN, "Drive ready in %lu ms.", (unsigned long)ms);
+                else     debug_print(1, FG_RED, "Drive not responding.");
             }
             continue;
         }
@@ -933,9 +1310,9 @@ void core1_entry(void) {
         if (current_screen == SCREEN_CONFIRM) {
             if (k == 'y' || k == 'Y') {
                 if (confirm_type == 0) { config_defaults(); sync_from_config(); config_save(); current_screen = SCREEN_MAIN; }
-                else if (confirm_type == 1) { sync_to_config(); config_save(); current_screen = confirm_return_screen; }
-                else if (confirm_type == 3) { is_mounted = true; media_changed_waiting = true; current_screen = SCREEN_MOUNTED; }
-                else if (confirm_type == 4) { is_mounted = false; media_changed_waiting = true; current_screen = SCREEN_MAIN; }
+                else if (confirm_type == 1) { sync_to_config(); config_save(); badmap_service(true); current_screen = confirm_return_screen; }
+                else if (confirm_type == 3) { mount_luns(prepare_luns()); current_screen = SCREEN_MOUNTED; }
+                else if (confirm_type == 4) { unmount_luns(); current_screen = SCREEN_MAIN; }
                 needs_full_redraw = true;
             } else if (k == 'n' || k == 'N' || k == KEY_ESC) {
                 current_screen = (confirm_type == 1) ? confirm_return_screen :
@@ -962,14 +1339,22 @@ void core1_entry(void) {
             }
             else if (k == KEY_ENTER) {
                 if (config.main_selected == 0) {
-                    // Auto Detect — single reset, probe master then slave
+                    // Auto Detect — single reset, diagnostic finds master and slave
                     uint16_t id_buf[256];
                     bool detected = false;
-                    uint8_t found = ide_probe_devices();
+                    uint8_t found = detect_device();
                     if (found) {
-                        ide_select_device(found);
                         config.dev_base = found;
-                        if (ide_identify(id_buf)) detected = true;
+                        sync_from_config();         // this drive's geometry
+                        const uint16_t *id = ide_cached_identify(found);
+                        if (id) {
+                            memcpy(id_buf, id, sizeof(id_buf));
+                            ide_negotiate_pio_mode(id_buf);
+                            ide_negotiate_multiple(id_buf);
+                            ide_set_write_cache(id_buf, config.write_cache);
+                            badmap_select(id_buf);
+                            detected = true;
+                        }
                     }
                     if (!detected) ide_select_device(config.dev_base);
                     if (detected) {
@@ -1056,14 +1441,20 @@ void core1_entry(void) {
             }
         } else if (current_screen == SCREEN_FEATURES) {
             if (k == KEY_UP && config.feat_selected > 0) config.feat_selected--;
-            else if (k == KEY_DOWN && config.feat_selected < 4) config.feat_selected++;
+            else if (k == KEY_DOWN && config.feat_selected < 10) config.feat_selected++;
             else if (k == KEY_ESC) current_screen = SCREEN_MAIN;
             else if (k == KEY_ENTER) {
-                if (config.feat_selected == 0) config.drive_write_protected = !config.drive_write_protected;
+                if (config.feat_selected == 0) { lun_config_t *l = config_lun(config.dev_base); l->write_protected = !l->write_protected; }
                 else if (config.feat_selected == 1) config.auto_mount = !config.auto_mount;
-                else if (config.feat_selected == 2) { config.iordy_enabled = !config.iordy_enabled; ide_set_iordy(config.iordy_enabled); }
-                else if (config.feat_selected == 3) config.intrq_enabled = !config.intrq_enabled;
-                else if (config.feat_selected == 4) current_screen = SCREEN_DEBUG;
+                else if (config.feat_selected == 2) apply_handshake(!ide_get_iordy(), ide_get_intrq());
+                else if (config.feat_selected == 3) apply_handshake(ide_get_iordy(), !ide_get_intrq());
+                else if (config.feat_selected == 4) config.chs_track_split = !config.chs_track_split;
+                else if (config.feat_selected == 5) config.fail_ceiling_ms = (config.fail_ceiling_ms >= 16000) ? 1000 : config.fail_ceiling_ms * 2;   // 1-16 s
+                else if (config.feat_selected == 6) config.retry_known_bad = !config.retry_known_bad;
+                else if (config.feat_selected == 7) { config.write_cache = !config.write_cache; apply_write_cache(); }
+                else if (config.feat_selected == 8) config.lookahead = (config.lookahead + 1) % 3;   // Auto/On/Off
+                else if (config.feat_selected == 9) run_auto_tune();
+                else if (config.feat_selected == 10) current_screen = SCREEN_DEBUG;
             }
             needs_full_redraw = true;
         }
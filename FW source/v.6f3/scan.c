@@ -0,0 +1,99 @@
+// ATAboy surface scan — runs on core 1 from the debug screen.
+// READ VERIFY SECTORS keeps the data on the drive, so the scan runs at
+// media speed rather than bus or USB speed.  Each chunk is timed and
+// classed; sectors the drive reports unreadable (UNC/BBK) go into the
+// bad-sector map so a later image skips them at once.
+
+#include "scan.h"
+#include "ide.h"
+#include "badmap.h"
+#include "config.h"
+#include "pico/stdlib.h"
+#include <string.h>
+
+#define SCAN_MAX_HANGS      8       // consecutive chunks without an answer
+
+// ---------------------------------------------------------------------------
+//  Chunk times — 8 buckets per octave, so the median is within ~9%
+// ---------------------------------------------------------------------------
+
+#define HIST_BUCKETS        256
+
+static uint32_t hist[HIST_BUCKETS];
+static uint32_t hist_n;
+
+static int bucket(uint32_t us) {
+    if (us < 8) return (int)us;
+    int e = 31 - __builtin_clz(us);
+    return (e << 3) | (int)((us >> (e - 3)) & 7);
+}
+
+static uint32_t bucket_us(int k) {
+    return k < 8 ? (uint32_t)k : (8u | (k & 7)) << ((k >> 3) - 3);
+}
+
+// Lower edge of the bucket holding the median; 0 before the first chunk
+static uint32_t median_us(void) {
+    uint32_t sum = 0;
+    for (int k = 0; k < HIST_BUCKETS; k++)
+        if (hist[k] && (sum += hist[k]) * 2 >= hist_n) return bucket_us(k);
+    return 0;
+}
+
+static scan_class_t classify(uint32_t us, uint32_t median) {
+    if (!median) return SCAN_OK;
+    if (us > median * SCAN_VERY_SLOW_X) return SCAN_VERY_SLOW;
+    if (us > median * SCAN_SLOW_X) return SCAN_SLOW;
+    return SCAN_OK;
+}
+
+scan_status_t scan_surface(scan_progress_t cb, scan_result_t *res) {
+    memset(res, 0, sizeof(*res));
+    memset(hist, 0, sizeof(hist));
+    hist_n = 0;
+    res->total = config_lun_sectors(config_lun(ide_get_device()));
+    if (!res->total) return SCAN_NO_GEOMETRY;
+
+    uint64_t lba = 0;
+    int hangs = 0;
+    while (lba < res->total) {
+        scan_chunk_t c = {.lba = lba, .cls = SCAN_OK};
+        c.count = (res->total - lba < SCAN_CHUNK) ? (uint32_t)(res->total - lba) : SCAN_CHUNK;
+
+        uint64_t bad = lba;
+        uint8_t err = 0;
+        absolute_time_t t0 = get_absolute_time();
+        int r = ide_verify_sectors(lba, c.count, &bad, &err);
+        c.us = (uint32_t)absolute_time_diff_us(t0, get_absolute_time());
+
+        if (r == 0) {
+            c.cls = classify(c.us, res->median_us);
+            hist[bucket(c.us)]++;
+            hist_n++;
+            res->median_us = median_us();
+            hangs = 0;
+        } else if (r == -1) {
+            // Pin the error, then resume right behind it
+            c.cls = SCAN_ERROR;
+            c.bad_lba = bad;
+            c.count = (uint32_t)(bad - lba) + 1;
+            if (err & IDE_ERR_UNREADABLE) {
+                badmap_add(bad, 1);
+                res->bad_sectors++;
+            }
+            hangs = 0;
+        } else {
+            c.cls = SCAN_ERROR;
+            c.bad_lba = lba;
+            c.no_answer = true;
+            if (++hangs >= SCAN_MAX_HANGS) return SCAN_DRIVE_LOST;
+        }
+
+        lba += c.count;
+        res->done = lba;
+        res->n[c.cls]++;
+        if (c.us > res->max_us) res->max_us = c.us;
+        if (cb && !cb(&c, res)) return SCAN_ABORTED;
+    }
+    return SCAN_DONE;
+}
@@ -0,0 +1,55 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Latency class of one scanned chunk, worst first wins in a heatmap cell.
+typedef enum {
+    SCAN_OK,
+    SCAN_SLOW,              // drive retried or remapped on the fly
+    SCAN_VERY_SLOW,         // imaging will stall here
+    SCAN_ERROR,             // media error or no answer
+    SCAN_CLASSES
+} scan_class_t;
+
+// Chunks are classed against the drive's own running median chunk time,
+// so a slow old drive isn't all 'slow' and a fast one still shows retries
+#define SCAN_CHUNK          256     // sectors per READ VERIFY
+#define SCAN_SLOW_X         4       // times the median
+#define SCAN_VERY_SLOW_X    16
+
+typedef struct {
+    uint64_t lba;
+    uint32_t count;
+    uint32_t us;
+    scan_class_t cls;
+    uint64_t bad_lba;       // first unreadable sector (SCAN_ERROR)
+    bool     no_answer;     // SCAN_ERROR by timeout: whole chunk skipped
+} scan_chunk_t;
+
+typedef struct {
+    uint64_t total;         // sectors on the drive
+    uint64_t done;
+    uint32_t n[SCAN_CLASSES];
+    uint32_t bad_sectors;   // added to the bad-sector map
+    uint32_t max_us;
+    uint32_t median_us;     // of the chunks read so far
+} scan_result_t;
+
+typedef enum {
+    SCAN_DONE,
+    SCAN_ABORTED,           // progress callback returned false
+    SCAN_NO_GEOMETRY,
+    SCAN_DRIVE_LOST         // stopped answering commands
+} scan_status_t;
+
+// Called after every chunk; return false to stop the scan.
+typedef bool (*scan_progress_t)(const scan_chunk_t *c, const scan_result_t *r);
+
+// READ VERIFY the whole configured LBA or CHS space, timing each chunk.
+// Media errors are pinned to the sector and added to the bad-sector map,
+// and the scan carries on behind them.  Runs on core 1 only, unmounted.
+scan_status_t scan_surface(scan_progress_t cb, scan_result_t *res);
+
+#endif
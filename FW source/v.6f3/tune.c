@@ -0,0 +1,260 @@
+// ATAboy Auto Tune Bus — runs on core 1 from the Features menu.
+// Sweeps PIO timing x IORDY x INTRQ.  Each combination gets WRITE BUFFER /
+// READ BUFFER loopback with known patterns plus sequential READ SECTORS
+// passes checked against a reference read at safe timing.  Of the
+// error-free combinations the highest mode with the least margin is kept,
+// with a safety margin on top, and stored for this drive and position.
+
+#include "tune.h"
+#include "ide.h"
+#include "ide_pio.h"
+#include "config.h"
+#include "hardware/gpio.h"
+#include "pico/stdlib.h"
+#include <string.h>
+
+#define TUNE_READ_SECTORS   64      // sectors per sequential read pass
+#define TUNE_READ_CHUNK     16      // sectors per READ SECTORS command
+#define TUNE_PATTERNS       4       // loopback patterns per combination
+#define TUNE_SAFETY_PCT     25      // stretch added to the fastest passing step
+#define TUNE_VERIFY_PASSES  3
+#define TUNE_MAX_MARGIN     200
+#define TUNE_TIE_PCT        5       // IORDY/INTRQ must be this much faster to win
+
+#define LA_CMDS             32      // look-ahead bench: commands per pass
+#define LA_SECTORS          8       // 4 KB, a typical small host read
+#define LA_GAP_US           4000    // about the time USB 1.1 takes to ship it
+
+static const uint8_t margins[] = {0, 20, 50};
+#define N_MARGINS (int)(sizeof(margins) / sizeof(margins[0]))
+
+// 4-byte aligned so sector bursts take the DMA path
+static uint8_t  read_buf[TUNE_READ_CHUNK * 512] __attribute__((aligned(4)));
+static uint16_t pat_out[256] __attribute__((aligned(4)));
+static uint16_t pat_in[256] __attribute__((aligned(4)));
+
+static bool     loopback_ok;        // drive implements READ/WRITE BUFFER
+static bool     have_geo;           // geometry set, sector reads possible
+static uint32_t ref_crc;
+
+// ---------------------------------------------------------------------------
+//  Patterns + CRC
+// ---------------------------------------------------------------------------
+
+static void fill_pattern(uint16_t *w, int n) {
+    uint32_t lfsr = 0xACE1u + (uint32_t)n;
+    for (int i = 0; i < 256; i++) {
+        switch (n) {
+        case 0:  w[i] = (i & 1) ? 0xFFFF : 0x0000; break;     // all lines toggle
+        case 1:  w[i] = (i & 1) ? 0xAAAA : 0x5555; break;     // adjacent crosstalk
+        case 2:  w[i] = (uint16_t)(1u << (i & 15)); break;    // walking one
+        default:
+            lfsr = (lfsr >> 1) ^ (-(lfsr & 1u) & 0xB400u);    // 16-bit Galois LFSR
+            w[i] = (uint16_t)lfsr;
+            break;
+        }
+    }
+}
+
+static uint32_t crc32_update(uint32_t crc, const uint8_t *p, uint32_t n) {
+    crc = ~crc;
+    while (n--) {
+        crc ^= *p++;
+        for (int k = 0; k < 8; k++) crc = (crc >> 1) ^ (0xEDB88320u & -(crc & 1u));
+    }
+    return ~crc;
+}
+
+// ---------------------------------------------------------------------------
+//  Test passes
+// ---------------------------------------------------------------------------
+
+static bool read_pass(uint32_t *crc) {
+    uint32_t c = 0;
+    for (uint32_t lba = 0; lba < TUNE_READ_SECTORS; lba += TUNE_READ_CHUNK) {
+        if (ide_read_sectors_raw(lba, TUNE_READ_CHUNK, read_buf) < 0) return false;
+        c = crc32_update(c, read_buf, sizeof(read_buf));
+    }
+    *crc = c;
+    return true;
+}
+
+static bool loopback_pass(bool want_intrq) {
+    for (int p = 0; p < TUNE_PATTERNS; p++) {
+        bool irq = false;
+        fill_pattern(pat_out, p);
+        memset(pat_in, 0, sizeof(pat_in));
+        if (ide_buffer_loopback(pat_out, pat_in, &irq) != 0) return false;
+        if (want_intrq && !irq) return false;     // INTRQ enabled but never delivered
+    }
+    return true;
+}
+
+static void apply(const tune_result_t *r) {
+    ide_set_handshake(r->iordy, r->intrq);
+    ide_pio_set_margin(r->margin);
+    ide_pio_set_mode(r->mode);
+}
+
+static bool run_combo(tune_result_t *r) {
+    apply(r);
+    uint32_t t0 = time_us_32();
+
+    r->pass = true;
+    if (loopback_ok && !loopback_pass(r->intrq)) r->pass = false;
+
+    uint32_t crc;
+    if (r->pass && have_geo && (!read_pass(&crc) || crc != ref_crc)) r->pass = false;
+
+    r->us = time_us_32() - t0;
+
+    // A corrupted transfer can leave the drive mid-command
+    if (!r->pass) ide_soft_reset();
+    return r->pass;
+}
+
+// ---------------------------------------------------------------------------
+//  Sweep
+// ---------------------------------------------------------------------------
+
+// Timing decides, not the clock: a higher mode, then a smaller margin.
+// Between IORDY/INTRQ choices at the same timing the wall time is mostly
+// noise, so the earlier (IORDY, INTRQ off first) stays unless clearly slower.
+static bool better(const tune_result_t *r, const tune_result_t *w) {
+    if (r->mode != w->mode) return r->mode > w->mode;
+    if (r->margin != w->margin) return r->margin < w->margin;
+    return (uint64_t)r->us * (100 + TUNE_TIE_PCT) < (uint64_t)w->us * 100;
+}
+
+tune_status_t tune_bus(const uint16_t *id, tune_progress_t cb, tune_result_t *best) {
+    tune_result_t saved = {
+        .mode = ide_pio_get_mode(), .margin = ide_pio_get_margin(),
+        .iordy = ide_get_iordy(), .intrq = ide_get_intrq(),
+    };
+
+    have_geo = config_lun_sectors(config_lun(ide_get_device())) > 0;
+
+    // Reference pass at Mode 0, double timing, no IORDY/INTRQ
+    tune_result_t safe = { .mode = 0, .margin = 100, .iordy = false, .intrq = false };
+    apply(&safe);
+    ide_set_features(0x03, 0x08);
+    fill_pattern(pat_out, 0);
+    loopback_ok = (ide_buffer_loopback(pat_out, pat_in, NULL) == 0);
+    if (!loopback_ok) ide_soft_reset();
+    if (have_geo && !read_pass(&ref_crc)) have_geo = false;
+
+    if (!loopback_ok && !have_geo) { apply(&saved); return TUNE_NO_TEST; }
+
+    // IORDY is only a candidate if the drive isn't holding it low at idle
+    ide_set_iordy(true);
+    busy_wait_us_32(10);
+    bool iordy_ok = gpio_get(IDE_IORDY);
+    ide_set_iordy(false);
+
+    // Top mode as if IORDY were on when it can be: word 68 then, word 67
+    // (no flow control, modes 0-2) without
+    uint8_t top = ide_best_pio_mode(id, iordy_ok);
+
+    // Modes 3-4 are only run with IORDY (it is what they rely on)
+    int n_iordy = iordy_ok ? 2 : 1;
+    int total = 0;
+    for (int m = top; m >= 0; m--) total += N_MARGINS * (m > 2 ? 1 : n_iordy) * 2;
+    int done = 0;
+    bool found = false;
+    tune_result_t win = safe;
+
+    for (int m = top; m >= 0; m--) {
+        // Tell the drive; modes 3-4 are skipped if it refuses them
+        if (!ide_set_features(0x03, 0x08 | m) && m > 2) {
+            done += N_MARGINS * 2;
+            continue;
+        }
+        for (int g = 0; g < N_MARGINS; g++) {
+            for (int io = m > 2 ? 1 : 0; io < n_iordy; io++) {
+                for (int iq = 0; iq < 2; iq++) {
+                    tune_result_t r = {
+                        .mode = (uint8_t)m, .margin = margins[g],
+                        .iordy = io != 0, .intrq = iq != 0,
+                    };
+                    run_combo(&r);
+                    done++;
+                    if (r.pass && (!found || better(&r, &win))) { win = r; found = true; }
+                    if (cb && !cb(&r, done, total)) {
+                        apply(&saved);
+                        ide_set_features(0x03, 0x08 | saved.mode);
+                        return TUNE_ABORTED;
+                    }
+                }
+            }
+        }
+    }
+
+    if (!found) {
+        apply(&saved);
+        ide_set_features(0x03, 0x08 | saved.mode);
+        return TUNE_NO_PASS;
+    }
+
+    // Safety margin on top of the winner; widen until repeated passes hold
+    ide_set_features(0x03, 0x08 | win.mode);
+    win.margin += TUNE_SAFETY_PCT;
+    while (true) {
+        bool ok = true;
+        for (int v = 0; v < TUNE_VERIFY_PASSES && ok; v++) ok = run_combo(&win);
+        if (ok) break;
+        if (win.margin >= TUNE_MAX_MARGIN) {
+            apply(&saved);
+            ide_set_features(0x03, 0x08 | saved.mode);
+            return TUNE_NO_PASS;
+        }
+        win.margin += TUNE_SAFETY_PCT;
+    }
+
+    lun_config_t *l = config_lun(ide_get_device());
+    l->tuned         = true;
+    l->tune_pio_mode = win.mode;
+    l->tune_margin   = win.margin;
+    l->tune_iordy    = win.iordy;
+    l->tune_intrq    = win.intrq;
+    l->tune_tag      = ide_identify_tag(id);
+    apply(&win);
+    if (best) *best = win;
+    return TUNE_OK;
+}
+
+// ---------------------------------------------------------------------------
+//  Read look-ahead
+// ---------------------------------------------------------------------------
+// Without look-ahead, the sectors after a short read pass under the heads
+// while the host is still fetching the data, and the next read waits most
+// of a revolution for them.  The second pass reads the range after the
+// first so neither finds its data already in the drive's buffer.
+
+static bool la_pass(uint64_t base, uint32_t *us) {
+    uint32_t t0 = time_us_32();
+    for (uint32_t i = 0; i < LA_CMDS; i++) {
+        if (ide_read_sectors_raw(base + i * LA_SECTORS, LA_SECTORS, read_buf) < 0) return false;
+        busy_wait_us_32(LA_GAP_US);
+    }
+    *us = time_us_32() - t0;
+    return true;
+}
+
+bool tune_lookahead(bool *keep, uint32_t *us_off, uint32_t *us_on) {
+    uint64_t total = config_lun_sectors(config_lun(ide_get_device()));
+    if (total < 2 * LA_CMDS * LA_SECTORS) return false;
+
+    uint32_t off, on;
+    if (!ide_set_lookahead(false)) return false;
+    if (!la_pass(0, &off) || !ide_set_lookahead(true) ||
+        !la_pass(LA_CMDS * LA_SECTORS, &on)) {
+        ide_set_lookahead(true);
+        return false;
+    }
+    // Drives that ignore the setting time the same; leave those on
+    *keep = on <= off + off / 50;
+    if (!*keep) ide_set_lookahead(false);
+    if (us_off) *us_off = off;
+    if (us_on) *us_on = on;
+    return true;
+}
@@ -0,0 +1,39 @@
+#ifndef TUNE_H
+#define TUNE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// One point in the Auto Tune Bus matrix and its outcome.
+typedef struct {
+    uint8_t  mode;          // PIO mode 0-4
+    uint8_t  margin;        // % timing stretch
+    bool     iordy;
+    bool     intrq;
+    bool     pass;
+    uint32_t us;            // wall time of the combination's test passes
+} tune_result_t;
+
+typedef enum {
+    TUNE_OK,
+    TUNE_ABORTED,           // progress callback returned false
+    TUNE_NO_TEST,           // no READ/WRITE BUFFER and no geometry to read with
+    TUNE_NO_PASS            // nothing ran error-free, settings left unchanged
+} tune_status_t;
+
+// Called after every combination; return false to abort the sweep.
+typedef bool (*tune_progress_t)(const tune_result_t *r, int done, int total);
+
+// Sweep PIO timing x IORDY x INTRQ for the drive whose IDENTIFY data is in
+// id[].  On TUNE_OK the winning settings (with safety margin) are written
+// to this position's lun_config_t and applied to the bus; otherwise the
+// previous bus settings are restored.  Runs on core 1 only.
+tune_status_t tune_bus(const uint16_t *id, tune_progress_t cb, tune_result_t *best);
+
+// Time small sequential reads, spaced like USB host requests, with read
+// look-ahead off and then on.  *keep: leave it on (it did not measure
+// slower); the drive is left that way.  false if the drive refuses the
+// setting or a read fails.  Needs geometry; runs on core 1 only.
+bool tune_lookahead(bool *keep, uint32_t *us_off, uint32_t *us_on);
+
+#endif
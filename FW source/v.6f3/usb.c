@@ -1,34 +1,140 @@
 // MSC callbacks — called on core 0 from within tud_task().
 // NEVER call tud_task() from here.  IDE wait loops use busy_wait only.
+// LUN 0 is the master drive, LUN 1 the slave.  Every command that reaches
+// a drive holds the bus lock while it runs, and checks the LUN is still
+// mounted once it has it.
 
 #include "tusb.h"
 #include "class/msc/msc_device.h"
+#include "device/usbd_pvt.h"
 #include "ide.h"
 #include "config.h"
 #include <string.h>
 
 extern volatile bool is_mounted;
-extern volatile bool media_changed_waiting;
+extern volatile uint8_t mounted_luns;
+extern volatile uint8_t media_changed_luns;
+extern volatile uint32_t msc_last_us;
+
+#define MSC_LUNS    2
 
 // ---------------------------------------------------------------------------
 //  Helpers
 // ---------------------------------------------------------------------------
 
-static uint64_t total_sectors(void) {
-    if (!is_mounted) return 0;
-    if (config.use_lba_mode) return config.lba_sectors;
-    return (uint64_t)config.cyls * config.heads * config.spt;
+static inline uint8_t lun_base(uint8_t lun) { return lun ? 0xB0 : 0xA0; }
+
+static inline bool IDE_HOT(lun_ready)(uint8_t lun) {
+    return is_mounted && lun < MSC_LUNS && (mounted_luns & (1u << lun));
+}
+
+static inline bool lun_protected(uint8_t lun) {
+    return config_lun(lun_base(lun))->write_protected;
+}
+
+// The host sees at most 2^32 sectors (2 TiB): TinyUSB streams only
+// READ10/WRITE10 through the transfer callbacks, and a WRITE(16) larger
+// than the class buffer never reaches us.  A bigger drive shows its first
+// 2 TiB at full speed rather than all of it with writes that fail.
+#define MSC_MAX_SECTORS     0x100000000ull
+
+static uint64_t IDE_HOT(total_sectors)(uint8_t lun) {
+    if (!lun_ready(lun)) return 0;
+    uint64_t n = config_lun_sectors(config_lun(lun_base(lun)));
+    return n < MSC_MAX_SECTORS ? n : MSC_MAX_SECTORS;
+}
+
+static __force_inline uint64_t get_be(const uint8_t *p, int n) {
+    uint64_t v = 0;
+    while (n--) v = (v << 8) | *p++;
+    return v;
+}
+
+static void put_be(uint8_t *p, uint64_t v, int n) {
+    while (n--) { p[n] = (uint8_t)v; v >>= 8; }
+}
+
+// ---------------------------------------------------------------------------
+//  Medium errors — failing LBA in the sense INFORMATION field
+// ---------------------------------------------------------------------------
+// A transfer that fails part-way returns the data before the first bad
+// sector as a short transfer.  The stack calls back for the rest at the
+// bad LBA, which then fails without touching the drive again, so the CSW
+// residue covers exactly the sectors from the bad one on.
+
+#define ASC_WRITE_ERROR     0x03
+#define ASC_READ_ERROR      0x11        // unrecovered read error
+
+typedef struct {
+    bool     pending;           // next transfer starting at 'lba' fails at once
+    bool     info_valid;        // 'lba' goes into the next sense data
+    bool     write;             // pending on a write transfer
+    uint8_t  asc;
+    uint64_t lba;
+} media_err_t;
+
+static media_err_t media_errs[MSC_LUNS];
+
+static void IDE_HOT(medium_error)(uint8_t lun, uint8_t asc, uint64_t lba) {
+    tud_msc_set_sense(lun, SCSI_SENSE_MEDIUM_ERROR, asc, 0x00);
+    media_errs[lun].info_valid = true;
+    media_errs[lun].lba = lba;
+}
+
+// The failed ide_*_sectors() call started 'done' bytes into the buffer:
+// return the good bytes ahead of the bad sector, or fail now if none
+static int32_t IDE_HOT(xfer_failed)(uint8_t lun, bool write, uint8_t asc, uint32_t done) {
+    media_err_t *m = &media_errs[lun];
+    ide_xfer_err_t e;
+    ide_get_xfer_error(&e);
+    done += e.good * 512;
+    if (done == 0) {
+        medium_error(lun, asc, e.first_bad);
+        return -1;
+    }
+    m->pending = true;
+    m->write = write;
+    m->asc = asc;
+    m->lba = e.first_bad;
+    return (int32_t)done;
+}
+
+// Continuation of a short transfer: fail at the bad LBA without a retry
+static bool IDE_HOT(xfer_pending)(uint8_t lun, bool write, uint64_t lba, uint32_t offset) {
+    media_err_t *m = &media_errs[lun];
+    if (!m->pending) return false;
+    m->pending = false;
+    if (write != m->write || lba != m->lba || offset) return false;
+    medium_error(lun, m->asc, lba);
+    return true;
+}
+
+// Fixed-format sense: the stack fills in key/ASC/ASCQ and always sets
+// VALID; keep VALID only when INFORMATION holds the failing LBA
+int32_t tud_msc_request_sense_cb(uint8_t lun, void *buffer, uint16_t bufsize) {
+    uint8_t *sense = (uint8_t *)buffer;
+    if (bufsize < 18 || lun >= MSC_LUNS) return bufsize;
+    media_err_t *m = &media_errs[lun];
+    bool valid = m->info_valid && (sense[2] & 0x0F) == SCSI_SENSE_MEDIUM_ERROR &&
+                 m->lba <= 0xFFFFFFFF;
+    sense[0] = valid ? 0xF0 : 0x70;
+    put_be(sense + 3, valid ? m->lba : 0, 4);
+    m->info_valid = false;
+    return 18;
 }
 
 // ---------------------------------------------------------------------------
 //  MSC Required Callbacks
 // ---------------------------------------------------------------------------
 
+uint8_t tud_msc_get_maxlun_cb(void) {
+    return MSC_LUNS;
+}
+
 void tud_msc_inquiry_cb(uint8_t lun, uint8_t vendor_id[8],
                         uint8_t product_id[16], uint8_t product_rev[4]) {
-    (void)lun;
     const char vid[] = "ATAboy";
-    const char pid[] = "Hard Drive";
+    const char *pid = lun ? "Hard Drive (S)" : "Hard Drive (M)";
     const char rev[] = "V0.6";
 
     memset(vendor_id, ' ', 8);
@@ -40,55 +146,106 @@ void tud_msc_inquiry_cb(uint8_t lun, uint8_t vendor_id[8],
 }
 
 bool tud_msc_is_writable_cb(uint8_t lun) {
-    (void)lun;
-    return !config.drive_write_protected;
+    return !lun_protected(lun);
 }
 
 bool tud_msc_test_unit_ready_cb(uint8_t lun) {
-    (void)lun;
-    return is_mounted;
+    return lun_ready(lun);
 }
 
 void tud_msc_capacity_cb(uint8_t lun, uint32_t *block_count,
                          uint16_t *block_size) {
-    (void)lun;
     *block_size = 512;
-    uint64_t ts = total_sectors();
+    // Last LBA 0xFFFFFFFE at most, so hosts stay on READ10/WRITE10
+    uint64_t ts = total_sectors(lun);
     *block_count = (ts > 0xFFFFFFFF) ? 0xFFFFFFFF : (uint32_t)ts;
 }
 
+// ---------------------------------------------------------------------------
+//  Built-in commands answered here instead — CBW opcode substitution
+// ---------------------------------------------------------------------------
+// TinyUSB answers MODE SENSE(6) itself, as a bare header without the
+// caching page (WCE), before tud_msc_scsi_cb() sees it.  The CBW is caught
+// as it arrives and the opcode changed to a private one the stack doesn't
+// know; tud_msc_scsi_cb() maps it back.  Both hooks are
+// linker --wrap symbols (CMakeLists.txt); the prototypes come from
+// usbd_pvt.h, so a TinyUSB that changes them fails to build rather than
+// misbehave.
+
+#define CBW_LEN             31
+#define OP_MODE_SENSE6      0xFE        // vendor range, never sent on by us
+
+static uint8_t *cbw_buf;                // where the MSC OUT endpoint receives a CBW
+static uint8_t  cbw_ep;
+static uint8_t  cbw_op, cbw_orig;       // substitution for the current command
+
+bool __real_usbd_edpt_xfer(uint8_t rhport, uint8_t ep_addr, uint8_t *buffer, uint16_t total_bytes);
+bool __real_mscd_xfer_cb(uint8_t rhport, uint8_t ep_addr, xfer_result_t event, uint32_t xferred_bytes);
+
+bool __wrap_usbd_edpt_xfer(uint8_t rhport, uint8_t ep_addr, uint8_t *buffer, uint16_t total_bytes) {
+    if (!(ep_addr & 0x80) && total_bytes == CBW_LEN) {
+        cbw_buf = buffer;
+        cbw_ep = ep_addr;
+    }
+    return __real_usbd_edpt_xfer(rhport, ep_addr, buffer, total_bytes);
+}
+
+bool __wrap_mscd_xfer_cb(uint8_t rhport, uint8_t ep_addr, xfer_result_t event, uint32_t xferred_bytes) {
+    if (cbw_buf && ep_addr == cbw_ep && event == XFER_RESULT_SUCCESS && xferred_bytes == CBW_LEN) {
+        uint32_t sig;
+        memcpy(&sig, cbw_buf, 4);
+        cbw_orig = cbw_buf[15];
+        cbw_op = 0;
+        if (sig == MSC_CBW_SIGNATURE && cbw_orig == 0x1A) cbw_op = OP_MODE_SENSE6;
+        if (cbw_op) cbw_buf[15] = cbw_op;
+    }
+    return __real_mscd_xfer_cb(rhport, ep_addr, event, xferred_bytes);
+}
+
+// Cached writes reach the media before the host reports success: on
+// SYNCHRONIZE CACHE and when the host stops or ejects the unit
+static bool sync_cache(uint8_t lun) {
+    bool ok = true;
+    ide_bus_lock();
+    if (lun_ready(lun)) {
+        ide_select_device(lun_base(lun));
+        ok = ide_flush_cache();
+    }
+    ide_bus_unlock();
+    if (ok) return true;
+    tud_msc_set_sense(lun, SCSI_SENSE_MEDIUM_ERROR, 0x0C, 0x00);      // write error
+    return false;
+}
+
 bool tud_msc_start_stop_cb(uint8_t lun, uint8_t power_condition,
                            bool start, bool load_eject) {
-    (void)lun; (void)power_condition; (void)start; (void)load_eject;
+    (void)power_condition; (void)load_eject;
+    if (!start) return sync_cache(lun);
     return true;
 }
 
 // ---------------------------------------------------------------------------
-//  READ10 — block transfer with partial first/last sector handling
+//  READ10/16 — block transfer with partial first/last sector handling
 // ---------------------------------------------------------------------------
 
-int32_t tud_msc_read10_cb(uint8_t lun, uint32_t lba, uint32_t offset,
-                          void *buffer, uint32_t bufsize) {
-    (void)lun;
-    if (!is_mounted) return -1;
+static int32_t IDE_HOT(read_locked)(uint8_t lun, uint64_t lba, uint32_t offset,
+                                    void *buffer, uint32_t bufsize) {
+    if (xfer_pending(lun, false, lba, offset)) return -1;
 
-    uint64_t max = total_sectors();
+    uint64_t max = total_sectors(lun);
     if (max == 0) return -1;
 
     uint32_t remaining = bufsize;
     uint8_t *ptr = (uint8_t *)buffer;
-    uint32_t cur_lba = lba;
+    uint64_t cur_lba = lba;
 
     // Partial first sector (non-zero offset)
     if (offset && remaining > 0 && cur_lba < max) {
         uint8_t temp[512];
-        if (ide_read_sectors(cur_lba, 1, temp) < 0) {
-            tud_msc_set_sense(lun, SCSI_SENSE_MEDIUM_ERROR, 0x11, 0x00);
-            return -1;
-        }
+        if (ide_read_sectors(cur_lba, 1, temp) < 0) return xfer_failed(lun, false, ASC_READ_ERROR, 0);
         uint32_t n = 512 - offset;
         if (n > remaining) n = remaining;
-        memcpy(ptr, temp + offset, n);
+        ide_memmove(ptr, temp + offset, n);
         ptr += n; remaining -= n; cur_lba++;
     }
 
@@ -96,58 +253,66 @@ int32_t tud_msc_read10_cb(uint8_t lun, uint32_t lba, uint32_t offset,
     uint32_t aligned = remaining / 512;
     if (aligned > 0 && cur_lba < max) {
         if (cur_lba + aligned > max) aligned = (uint32_t)(max - cur_lba);
-        if (ide_read_sectors(cur_lba, aligned, ptr) < 0) {
-            tud_msc_set_sense(lun, SCSI_SENSE_MEDIUM_ERROR, 0x11, 0x00);
-            return -1;
-        }
+        if (ide_read_sectors(cur_lba, aligned, ptr) < 0)
+            return xfer_failed(lun, false, ASC_READ_ERROR, (uint32_t)(ptr - (uint8_t *)buffer));
         ptr += aligned * 512; remaining -= aligned * 512; cur_lba += aligned;
     }
 
     // Partial last sector
     if (remaining > 0 && cur_lba < max) {
         uint8_t temp[512];
-        if (ide_read_sectors(cur_lba, 1, temp) < 0) {
-            tud_msc_set_sense(lun, SCSI_SENSE_MEDIUM_ERROR, 0x11, 0x00);
-            return -1;
-        }
-        memcpy(ptr, temp, remaining);
+        if (ide_read_sectors(cur_lba, 1, temp) < 0)
+            return xfer_failed(lun, false, ASC_READ_ERROR, (uint32_t)(ptr - (uint8_t *)buffer));
+        ide_memmove(ptr, temp, remaining);
         ptr += remaining; remaining = 0;
     }
 
-    if (remaining > 0) memset(ptr, 0, remaining);
+    if (remaining > 0) ide_memset(ptr, 0, remaining);
     return (int32_t)bufsize;
 }
 
+static int32_t IDE_HOT(msc_read)(uint8_t lun, uint64_t lba, uint32_t offset,
+                                 void *buffer, uint32_t bufsize) {
+    if (!lun_ready(lun)) return -1;
+    int32_t r = -1;
+    ide_bus_lock();
+    if (lun_ready(lun)) {                   // not unmounted while we waited
+        ide_select_device(lun_base(lun));
+        r = read_locked(lun, lba, offset, buffer, bufsize);
+    }
+    ide_bus_unlock();
+    msc_last_us = time_us_32();
+    return r;
+}
+
+int32_t IDE_HOT(tud_msc_read10_cb)(uint8_t lun, uint32_t lba, uint32_t offset,
+                                   void *buffer, uint32_t bufsize) {
+    return msc_read(lun, lba, offset, buffer, bufsize);
+}
+
 // ---------------------------------------------------------------------------
-//  WRITE10 — block transfer with partial first/last read-modify-write
+//  WRITE10/16 — block transfer with partial first/last read-modify-write
 // ---------------------------------------------------------------------------
 
-int32_t tud_msc_write10_cb(uint8_t lun, uint32_t lba, uint32_t offset,
-                           uint8_t *buffer, uint32_t bufsize) {
-    (void)lun;
-    if (!is_mounted || config.drive_write_protected) return -1;
+static int32_t IDE_HOT(write_locked)(uint8_t lun, uint64_t lba, uint32_t offset,
+                                     uint8_t *buffer, uint32_t bufsize) {
+    if (xfer_pending(lun, true, lba, offset)) return -1;
 
-    uint64_t max = total_sectors();
+    uint64_t max = total_sectors(lun);
     if (max == 0) return -1;
 
     uint32_t remaining = bufsize;
     uint8_t *ptr = buffer;
-    uint32_t cur_lba = lba;
+    uint64_t cur_lba = lba;
 
     // Partial first sector — read-modify-write
     if (offset && remaining > 0 && cur_lba < max) {
         uint8_t temp[512];
-        if (ide_read_sectors(cur_lba, 1, temp) < 0) {
-            tud_msc_set_sense(lun, SCSI_SENSE_MEDIUM_ERROR, 0x11, 0x00);
-            return -1;
-        }
+        if (ide_read_sectors(cur_lba, 1, temp) < 0) return xfer_failed(lun, true, ASC_READ_ERROR, 0);
         uint32_t n = 512 - offset;
         if (n > remaining) n = remaining;
-        memcpy(temp + offset, ptr, n);
-        if (ide_write_sectors(cur_lba, 1, temp) < 0) {
-            tud_msc_set_sense(lun, SCSI_SENSE_MEDIUM_ERROR, 0x03, 0x00);
-            return -1;
-        }
+        ide_memmove(temp + offset, ptr, n);
+        if (ide_write_sectors(cur_lba, 1, temp) < 0) return xfer_failed(lun, true, ASC_WRITE_ERROR, 0);
         ptr += n; remaining -= n; cur_lba++;
     }
 
@@ -155,31 +320,97 @@ int32_t tud_msc_write10_cb(uint8_t lun, uint32_t lba, uint32_t offset,
     uint32_t aligned = remaining / 512;
     if (aligned > 0 && cur_lba < max) {
         if (cur_lba + aligned > max) aligned = (uint32_t)(max - cur_lba);
-        if (ide_write_sectors(cur_lba, aligned, ptr) < 0) {
-            tud_msc_set_sense(lun, SCSI_SENSE_MEDIUM_ERROR, 0x03, 0x00);
-            return -1;
-        }
+        if (ide_write_sectors(cur_lba, aligned, ptr) < 0)
+            return xfer_failed(lun, true, ASC_WRITE_ERROR, (uint32_t)(ptr - buffer));
         ptr += aligned * 512; remaining -= aligned * 512; cur_lba += aligned;
     }
 
     // Partial last sector — read-modify-write
     if (remaining > 0 && cur_lba < max) {
         uint8_t temp[512];
-        if (ide_read_sectors(cur_lba, 1, temp) < 0) {
-            tud_msc_set_sense(lun, SCSI_SENSE_MEDIUM_ERROR, 0x11, 0x00);
-            return -1;
-        }
-        memcpy(temp, ptr, remaining);
-        if (ide_write_sectors(cur_lba, 1, temp) < 0) {
-            tud_msc_set_sense(lun, SCSI_SENSE_MEDIUM_ERROR, 0x03, 0x00);
-            return -1;
-        }
+        if (ide_read_sectors(cur_lba, 1, temp) < 0)
+            return xfer_failed(lun, true, ASC_READ_ERROR, (uint32_t)(ptr - buffer));
+        ide_memmove(temp, ptr, remaining);
+        if (ide_write_sectors(cur_lba, 1, temp) < 0)
+            return xfer_failed(lun, true, ASC_WRITE_ERROR, (uint32_t)(ptr - buffer));
         remaining = 0;
     }
 
     return (int32_t)bufsize;
 }
 
+static int32_t IDE_HOT(msc_write)(uint8_t lun, uint64_t lba, uint32_t offset,
+                                  uint8_t *buffer, uint32_t bufsize) {
+    if (!lun_ready(lun) || lun_protected(lun)) return -1;
+    int32_t r = -1;
+    ide_bus_lock();
+    if (lun_ready(lun)) {
+        ide_select_device(lun_base(lun));
+        r = write_locked(lun, lba, offset, buffer, bufsize);
+    }
+    ide_bus_unlock();
+    msc_last_us = time_us_32();
+    return r;
+}
+
+int32_t IDE_HOT(tud_msc_write10_cb)(uint8_t lun, uint32_t lba, uint32_t offset,
+                                    uint8_t *buffer, uint32_t bufsize) {
+    return msc_write(lun, lba, offset, buffer, bufsize);
+}
+
+// ---------------------------------------------------------------------------
+//  16-byte CDBs — READ CAPACITY(16), READ(16), WRITE(16)
+// ---------------------------------------------------------------------------
+// TinyUSB streams only READ10/WRITE10 through the callbacks above.  Other
+// commands move their data through the class buffer in one piece, so
+// READ(16) returns at most one buffer and lets the host re-issue the rest
+// from the residue; a WRITE(16) longer than the buffer is failed by the
+// stack before it reaches us.  Both only cover the same 2 TiB as the
+// 10-byte commands (MSC_MAX_SECTORS), for hosts that always send them.
+
+static int32_t read_capacity16(uint8_t lun, uint8_t const cmd[16], uint8_t *buf, uint16_t bufsize) {
+    uint64_t ts = total_sectors(lun);
+    if (ts == 0) {
+        tud_msc_set_sense(lun, SCSI_SENSE_NOT_READY, 0x3A, 0x00);
+        return -1;
+    }
+    uint32_t alloc = (uint32_t)get_be(cmd + 10, 4);
+    uint32_t len = 32;
+    if (len > alloc) len = alloc;
+    if (len > bufsize) len = bufsize;
+    uint8_t resp[32] = {0};
+    put_be(resp, ts - 1, 8);                        // last LBA
+    put_be(resp + 8, 512, 4);                       // block length
+    memcpy(buf, resp, len);
+    return (int32_t)len;
+}
+
+static int32_t IDE_HOT(rw16)(uint8_t lun, uint8_t const cmd[16], uint8_t *buf, uint16_t bufsize) {
+    bool write = (cmd[0] == 0x8A);
+    uint64_t lba = get_be(cmd + 2, 8);
+    uint64_t bytes = get_be(cmd + 10, 4) * 512;
+
+    uint64_t ts = total_sectors(lun);
+    if (ts == 0) {
+        tud_msc_set_sense(lun, SCSI_SENSE_NOT_READY, 0x3A, 0x00);         // medium not present
+        return -1;
+    }
+    if (lba >= ts || bytes / 512 > ts - lba) {
+        tud_msc_set_sense(lun, SCSI_SENSE_ILLEGAL_REQUEST, 0x21, 0x00);    // LBA out of range
+        return -1;
+    }
+    if (write && lun_protected(lun)) {
+        tud_msc_set_sense(lun, SCSI_SENSE_DATA_PROTECT, 0x27, 0x00);
+        return -1;
+    }
+    if (bytes > bufsize) bytes = bufsize - bufsize % 512;
+    if (bytes == 0) return 0;
+
+    // A short read leaves the rest to the host's retry at the bad LBA
+    return write ? msc_write(lun, lba, 0, buf, (uint32_t)bytes)
+                 : msc_read(lun, lba, 0, buf, (uint32_t)bytes);
+}
+
 // ---------------------------------------------------------------------------
 //  SCSI — Mode Sense + misc
 // ---------------------------------------------------------------------------
@@ -187,12 +418,16 @@ int32_t tud_msc_write10_cb(uint8_t lun, uint32_t lba, uint32_t offset,
 int32_t tud_msc_scsi_cb(uint8_t lun, uint8_t const scsi_cmd[16],
                         void *buffer, uint16_t bufsize) {
     uint8_t opcode = scsi_cmd[0];
+    // Back to the host's opcode; a private one the host sent itself
+    // stays unknown
+    if (cbw_op && opcode == cbw_op) opcode = cbw_orig;
+    cbw_op = 0;
     uint8_t *buf = (uint8_t *)buffer;
 
-    // Unit Attention on first access after mount/unmount
-    if (is_mounted && media_changed_waiting) {
+    // Unit Attention on first access after mount/unmount, once per LUN
+    if (lun_ready(lun) && (media_changed_luns & (1u << lun))) {
         tud_msc_set_sense(lun, SCSI_SENSE_UNIT_ATTENTION, 0x28, 0);
-        media_changed_waiting = false;
+        media_changed_luns &= (uint8_t)~(1u << lun);
         return -1;
     }
 
@@ -206,39 +441,64 @@ int32_t tud_msc_scsi_cb(uint8_t lun, uint8_t const scsi_cmd[16],
         if (bufsize < hdr) return -1;
         memset(buffer, 0, bufsize);
         uint16_t pos = hdr;
+        const lun_config_t *l = config_lun(lun_base(lun));
+        bool wp = lun_protected(lun);
 
         // Page 0x03: Format Device (SPT)
         if ((page == 0x03 || page == 0x3F) && pos + 24 <= bufsize) {
             buf[pos] = 0x03; buf[pos + 1] = 0x16;
-            buf[pos + 10] = (uint8_t)(config.spt >> 8);
-            buf[pos + 11] = (uint8_t)(config.spt & 0xFF);
+            buf[pos + 10] = 0;
+            buf[pos + 11] = l->spt;
             pos += 24;
         }
         // Page 0x04: Rigid Disk Geometry (Cyl/Heads)
         if ((page == 0x04 || page == 0x3F) && pos + 24 <= bufsize) {
             buf[pos] = 0x04; buf[pos + 1] = 0x16;
             buf[pos + 2] = 0;
-            buf[pos + 3] = (uint8_t)(config.cyls >> 8);
-            buf[pos + 4] = (uint8_t)(config.cyls & 0xFF);
-            buf[pos + 5] = config.heads;
+            buf[pos + 3] = (uint8_t)(l->cyls >> 8);
+            buf[pos + 4] = (uint8_t)(l->cyls & 0xFF);
+            buf[pos + 5] = l->heads;
             pos += 24;
         }
+        // Page 0x08: Caching (WCE — host then sends SYNCHRONIZE CACHE)
+        if ((page == 0x08 || page == 0x3F) && pos + 20 <= bufsize) {
+            buf[pos] = 0x08; buf[pos + 1] = 0x12;
+            bool wce = false;
+            ide_bus_lock();
+            if (lun_ready(lun)) {
+                ide_select_device(lun_base(lun));
+                wce = ide_get_write_cache();
+            }
+            ide_bus_unlock();
+            buf[pos + 2] = wce ? 0x04 : 0x00;
+            pos += 20;
+        }
 
         if (!is10) {
             buf[0] = (uint8_t)(pos - 1);
-            buf[2] = config.drive_write_protected ? 0x80 : 0x00;
+            buf[2] = wp ? 0x80 : 0x00;
         } else {
             uint16_t full = pos - 2;
             buf[0] = (uint8_t)(full >> 8);
             buf[1] = (uint8_t)(full & 0xFF);
-            buf[3] = config.drive_write_protected ? 0x80 : 0x00;
+            buf[3] = wp ? 0x80 : 0x00;
         }
         return (int32_t)pos;
     }
 
+    case 0x9E:            // SERVICE ACTION IN (16)
+        if ((scsi_cmd[1] & 0x1F) == 0x10) return read_capacity16(lun, scsi_cmd, buf, bufsize);
+        tud_msc_set_sense(lun, SCSI_SENSE_ILLEGAL_REQUEST, 0x24, 0);
+        return -1;
+    case 0x88:            // READ (16)
+    case 0x8A:            // WRITE (16)
+        return rw16(lun, scsi_cmd, buf, bufsize);
+
     case 0x00: return 0;  // TEST UNIT READY
     case 0x1B: return 0;  // START STOP UNIT
-    case 0x35: return 0;  // SYNCHRONIZE CACHE
+    case 0x35:            // SYNCHRONIZE CACHE (10)
+    case 0x91:            // SYNCHRONIZE CACHE (16)
+        return sync_cache(lun) ? 0 : -1;
     case 0x1E: return 0;  // PREVENT ALLOW MEDIUM REMOVAL
 
     default: